@@ -0,0 +1,2 @@
+local name = ...
+print( "Hello, " .. tostring( name ) .. "!" )
@@ -1,6 +1,7 @@
 #include "ballroom.h"
 
 #include <iostream>
+#include <thread>
 
 int main( int argc, const char* argv[] ) {
     using namespace disco;
@@ -9,11 +10,40 @@ int main( int argc, const char* argv[] ) {
     p.AddDancer( Dancer( "cat" ) );
     p.AddDancer( Dancer( "dog" ) );
     p.AddDancer( Dancer( "fish" ) );
+    p.EmplaceDancer( "frog" );
+    
+    // A whole guest list at once.
+    vector< string > guests = { "owl", "bat", "moth", "cat" };
+    p.AddDancers( guests );
     
     auto who = p.WhoIsAtThisParty();
     for( auto s : who ) {
         std::cout << s << '\n';
     }
     
+    // The same names, without copying them.
+    for( string_view s : p.Roster() ) {
+        std::cout << s << '\n';
+    }
+    
+    // A snapshot keeps showing the party as it was.
+    Party::Snapshot before = p.TakeSnapshot();
+    p.AddDancer( Dancer( "bird" ) );
+    std::cout << "Version " << before.Version() << " had " << before.Roster().size() << " dancers, version "
+              << p.Version() << " has " << p.Roster().size() << '\n';
+    
+    // Checking people in and out doesn't search the whole party.
+    p.RemoveDancer( "dog" );
+    std::cout << "Is the dog here? " << ( p.Contains( "dog" ) ? "yes" : "no" ) << '\n';
+    
+    // Guests can arrive from other threads. They come in together at `Commit()`.
+    std::thread door( [&p]() { p.Submit( "newt" ); p.Submit( "toad" ); } );
+    door.join();
+    p.Commit();
+    std::cout << "After the door opened: " << p.Published().Roster().size() << " dancers\n";
+    
+    // Both cats share one copy of their name. (Not counting the empty name every table has.)
+    std::cout << NameTable::Global().Size() - 1 << " different names\n";
+    
     return 0;
 }
@@ -0,0 +1,63 @@
+#include <iostream>
+#include <random>
+
+#include "broadphase.h"
+#include "ecs.h"
+
+using namespace ecs;
+
+struct Position { float x{}, y{}; };
+struct Velocity { float x{}, y{}; };
+// Width and height of the box that can be hit.
+struct Collider { float x{}, y{}; };
+struct Bullet {};
+struct Enemy { int hp{20}; };
+
+int main( int argc, const char* argv[] ) {
+    ECS ecs;
+    std::mt19937 rng( 7 );
+    std::uniform_real_distribution< float > coordinate( 0, 1000 );
+    std::uniform_real_distribution< float > speed( -4, 4 );
+
+    for( int i = 0; i < 200; ++i ) {
+        EntityID e = ecs.CreateEntity();
+        ecs.Add<Position>( e, coordinate( rng ), coordinate( rng ) );
+        ecs.Add<Collider>( e, 24.f, 24.f );
+        ecs.Add<Enemy>( e );
+    }
+    for( int i = 0; i < 20000; ++i ) {
+        EntityID e = ecs.CreateEntity();
+        ecs.Add<Position>( e, coordinate( rng ), coordinate( rng ) );
+        ecs.Add<Velocity>( e, speed( rng ), speed( rng ) );
+        ecs.Add<Collider>( e, 2.f, 2.f );
+        ecs.Add<Bullet>( e );
+    }
+
+    Broadphase< Position, Collider > broadphase( ecs );
+
+    for( int frame = 0; frame < 5; ++frame ) {
+        ecs.ForEach< Position, const Velocity >( []( Position& p, const Velocity& v ) { p.x += v.x; p.y += v.y; } );
+        broadphase.Update();
+
+        // Every overlapping pair comes out once, instead of testing all 200 million pairs.
+        // Bullets hitting bullets don't count. Hits destroy things, so they are recorded for later.
+        int hits = 0;
+        for( const auto& [a, b] : broadphase.Pairs() ) {
+            const bool a_is_bullet = ecs.Has<Bullet>( a ), b_is_bullet = ecs.Has<Bullet>( b );
+            if( a_is_bullet == b_is_bullet ) continue;
+            const EntityID bullet = a_is_bullet ? a : b;
+            const EntityID enemy = a_is_bullet ? b : a;
+            // An enemy can take many hits in one frame, but it only dies once.
+            Enemy& target = ecs.Get<Enemy>( enemy );
+            if( target.hp <= 0 ) continue;
+            if( --target.hp == 0 ) ecs.Commands().Destroy( enemy );
+            ecs.Commands().Destroy( bullet );
+            ++hits;
+        }
+        ecs.Playback();
+
+        std::cout << "Frame " << frame << ": " << broadphase.Pairs().size() << " overlaps, " << hits << " hits, " << ecs.NumEntities() << " entities left\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <iostream>
+
+#include "ecs.h"
+
+using namespace ecs;
+
+// Some components.
+struct Position { float x{}, y{}; };
+struct Velocity { float x{}, y{}; };
+// A tag component with no data. It comes and goes, so it lives in a sparse set.
+struct Frozen {
+    static constexpr Storage storage = Storage::SparseSet;
+};
+
+int main( int argc, const char* argv[] ) {
+    ECS ecs;
+
+    // Make some entities. Only some of them move.
+    for( int i = 0; i < 5; ++i ) {
+        EntityID e = ecs.CreateEntity();
+        ecs.Add<Position>( e, float(i), 0.f );
+        if( i % 2 == 0 ) ecs.Add<Velocity>( e, 1.f, 2.f );
+        if( i == 4 ) ecs.Add<Frozen>( e );
+    }
+
+    // A physics system. This is the same loop as the Lua `ECS.ForEach( {"position", "velocity"}, ... )`,
+    // but each component is found by indexing into an array rather than looking up a table.
+    const float dt = 0.5;
+    ecs.ForEach< Position, const Velocity, Without< Frozen > >( [&]( Position& p, const Velocity& v ) {
+        p.x += v.x * dt;
+        p.y += v.y * dt;
+    } );
+
+    // The same system, spread across all cores. Each thread gets ranges of entities.
+    // The result is identical to `ForEach()`, since each call only touches its own entity.
+    ecs.ParallelForEach< Position, const Velocity, Without< Frozen > >( [&]( Position& p, const Velocity& v ) {
+        p.x += v.x * dt;
+        p.y += v.y * dt;
+    } );
+
+    // An incremental system only looks at entities whose Position was written since it last ran.
+    // The first time, that's everyone. Nothing moves in between, so the second time it's no one.
+    uint64_t lastRun = 0;
+    for( int pass = 0; pass < 2; ++pass ) {
+        int visited = 0;
+        ecs.ForEach< const Position, Changed< Position > >( lastRun, [&]( const Position& ) { ++visited; } );
+        std::cout << "Pass " << pass << " saw " << visited << " moved entities\n";
+    }
+
+    // The callback can ask for the entity, too.
+    ecs.ForEach< const Position >( [&]( EntityID e, const Position& p ) {
+        std::cout << "Entity " << e << " is at (" << p.x << ", " << p.y << ")\n";
+    } );
+
+    return 0;
+}
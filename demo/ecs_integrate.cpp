@@ -0,0 +1,44 @@
+#include <chrono>
+#include <iostream>
+
+#include "ecs.h"
+#include "integrate.h"
+#include "scheduler.h"
+
+using namespace ecs;
+
+// `Integrate()` needs these to be exactly two floats.
+struct Position { float x{}, y{}; };
+struct Velocity { float x{}, y{}; };
+struct Projectile {};
+
+int main( int argc, const char* argv[] ) {
+    ECS ecs;
+    for( int i = 0; i < 200000; ++i ) {
+        EntityID e = ecs.CreateEntity();
+        ecs.Add<Position>( e );
+        ecs.Add<Velocity>( e, float( i % 100 ), 50.f );
+        ecs.Add<Projectile>( e );
+    }
+
+    Motion motion;
+    motion.dt = 1.f/60;
+    motion.gravity_y = -9.8f;
+    motion.drag = 0.1f;
+
+    // The built-in system, run by the scheduler like any other.
+    Scheduler scheduler;
+    scheduler.Add( "physics", Writes< Position, Velocity >(), [&]( ECS& ecs ) { Integrate< Position, Velocity >( ecs, motion ); } );
+    scheduler.Run( ecs );
+
+    // The same step with each instruction set this CPU has, for comparison.
+    for( Simd simd : { Simd::Scalar, Simd::SSE, Simd::AVX2 } ) {
+        if( int( simd ) > int( BestSimd() ) ) continue;
+        const auto start = std::chrono::steady_clock::now();
+        Integrate< Position, Velocity >( ecs, motion, simd );
+        const auto end = std::chrono::steady_clock::now();
+        std::cout << SimdName( simd ) << ": " << std::chrono::duration< double, std::milli >( end - start ).count() << " ms\n";
+    }
+
+    return 0;
+}
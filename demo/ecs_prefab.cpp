@@ -0,0 +1,48 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "ecs.h"
+
+using namespace ecs;
+
+struct Position { float x{}, y{}; };
+struct Velocity { float x{}, y{}; };
+struct Health { int hp{}; };
+struct Sprite { std::string image; };
+
+int main( int argc, const char* argv[] ) {
+    ECS ecs;
+
+    // Build one enemy the usual way, then keep a copy of it as a prefab.
+    EntityID goblin = ecs.CreateEntity();
+    ecs.Add<Position>( goblin, 0.f, 100.f );
+    ecs.Add<Velocity>( goblin, 0.f, -1.f );
+    ecs.Add<Health>( goblin, 30 );
+    ecs.Add<Sprite>( goblin, Sprite{ "goblin.png" } );
+    Prefab prefab = ecs.MakePrefab( goblin );
+    ecs.Destroy( goblin );
+
+    // A tougher variant of the same prefab.
+    Prefab boss = ecs.MakePrefab( ecs.SpawnBatch( prefab, 1 ).front() );
+    boss.TryGet<Health>()->hp = 500;
+
+    for( int wave = 0; wave < 3; ++wave ) {
+        const auto start = std::chrono::steady_clock::now();
+        std::vector< EntityID > spawned = ecs.SpawnBatch( prefab, 5000 );
+        ecs.SpawnBatch( boss, 1 );
+        const auto end = std::chrono::steady_clock::now();
+
+        // Each one can be customized afterwards.
+        for( size_t i = 0; i < spawned.size(); ++i ) ecs.Get<Position>( spawned[i] ).x = float( i % 100 );
+
+        std::cout << "Wave " << wave << " took " << std::chrono::duration< double, std::milli >( end - start ).count()
+                  << " ms; " << ecs.NumEntities() << " entities\n";
+    }
+
+    int bosses = 0;
+    ecs.ForEach< const Health >( [&]( const Health& h ) { if( h.hp == 500 ) ++bosses; } );
+    std::cout << bosses << " bosses\n";
+
+    return 0;
+}
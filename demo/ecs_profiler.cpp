@@ -0,0 +1,76 @@
+// This file replaces the global `operator new`, so allocations show up in the profile.
+#define ECS_PROFILER_COUNT_ALLOCATIONS
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "ecs.h"
+#include "integrate.h"
+#include "profiler.h"
+#include "scheduler.h"
+
+using namespace ecs;
+
+struct Position { float x{}, y{}; };
+struct Velocity { float x{}, y{}; };
+struct Health { int hp{100}; };
+struct Poisoned {};
+
+int main( int argc, const char* argv[] ) {
+    ECS ecs;
+    for( int i = 0; i < 50000; ++i ) {
+        EntityID e = ecs.CreateEntity();
+        ecs.Add<Position>( e );
+        ecs.Add<Velocity>( e, float( i % 7 ), 1.f );
+        ecs.Add<Health>( e );
+        if( i % 10 == 0 ) ecs.Add<Poisoned>( e );
+    }
+
+    Profiler profiler;
+    Scheduler scheduler;
+    scheduler.SetProfiler( &profiler );
+    scheduler.Add( "physics", Writes< Position, Velocity >(), []( ECS& ecs ) {
+        Motion motion;
+        motion.dt = 1.f/60;
+        motion.gravity_y = -9.8f;
+        Integrate< Position, Velocity >( ecs, motion );
+    } );
+    scheduler.Add( "poison", Reads< Poisoned >() + Writes< Health >(), []( ECS& ecs ) {
+        ecs.ForEach< Health, const Poisoned >( [&]( EntityID e, Health& h, const Poisoned& ) {
+            if( --h.hp <= 0 ) ecs.Commands().Destroy( e );
+        } );
+    } );
+    // Allocates on purpose, to have something to count.
+    scheduler.Add( "lowest", Reads< Position >(), []( ECS& ecs ) {
+        std::vector< float > heights;
+        ecs.ForEach< const Position >( [&]( const Position& p ) { heights.push_back( p.y ); } );
+        std::sort( heights.begin(), heights.end() );
+    } );
+
+    // Write the whole ring out every 60 frames. Open it in a spreadsheet.
+    profiler.DumpEvery( 60, "profile.csv", Profiler::Format::CSV );
+    for( int frame = 0; frame < 240; ++frame ) scheduler.Run( ecs );
+    profiler.Dump( "profile.json", Profiler::Format::JSON );
+
+    // Average each system over the frames still in the ring.
+    struct Total { uint64_t runs = 0, nanoseconds = 0, entities = 0, chunks = 0, allocations = 0; };
+    std::vector< Total > totals( profiler.NumSystems() );
+    for( const SystemSample& s : profiler.Samples() ) {
+        Total& t = totals[ s.system ];
+        ++t.runs;
+        t.nanoseconds += s.nanoseconds;
+        t.entities += s.entities;
+        t.chunks += s.chunks;
+        t.allocations += s.allocations;
+    }
+    for( uint32_t i = 0; i < totals.size(); ++i ) {
+        const Total& t = totals[i];
+        if( t.runs == 0 ) continue;
+        std::cout << profiler.Name( i ) << ": " << t.nanoseconds / t.runs / 1000.0 << " us, "
+                  << t.entities / t.runs << " entities in " << t.chunks / t.runs << " chunks, "
+                  << double( t.allocations ) / t.runs << " allocations per frame\n";
+    }
+
+    return 0;
+}
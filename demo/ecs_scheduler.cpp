@@ -0,0 +1,62 @@
+#include <iostream>
+
+#include "ecs.h"
+#include "scheduler.h"
+
+using namespace ecs;
+
+struct Position { float x{}, y{}; };
+struct Velocity { float x{}, y{}; };
+struct Brain { int mood{}; };
+struct Animation { int frame{}; };
+struct Voice { float volume{1}; };
+
+int main( int argc, const char* argv[] ) {
+    ECS ecs;
+    for( int i = 0; i < 1000; ++i ) {
+        EntityID e = ecs.CreateEntity();
+        ecs.Add<Position>( e );
+        ecs.Add<Velocity>( e, 1.f, 0.f );
+        ecs.Add<Brain>( e );
+        ecs.Add<Animation>( e );
+        ecs.Add<Voice>( e );
+    }
+
+    // Each system says which components it reads and writes.
+    Scheduler scheduler;
+    scheduler.Add( "ai", Reads< Position >() + Writes< Brain, Velocity >(), []( ECS& ecs ) {
+        ecs.ForEach< const Position, Brain, Velocity >( []( const Position& p, Brain& b, Velocity& v ) {
+            b.mood = p.x > 10 ? 1 : 0;
+            v.x = b.mood ? -1.f : 1.f;
+        } );
+    } );
+    scheduler.Add( "animation", Writes< Animation >(), []( ECS& ecs ) {
+        ecs.ForEach< Animation >( []( Animation& a ) { a.frame = ( a.frame + 1 ) % 8; } );
+    } );
+    scheduler.Add( "audio", Reads< Brain >() + Writes< Voice >(), []( ECS& ecs ) {
+        ecs.ForEach< const Brain, Voice >( []( const Brain& b, Voice& v ) { v.volume = b.mood ? 0.5f : 1.f; } );
+    } );
+    scheduler.Add( "physics", Reads< Velocity >() + Writes< Position >(), []( ECS& ecs ) {
+        ecs.ParallelForEach< Position, const Velocity >( []( Position& p, const Velocity& v ) { p.x += v.x; p.y += v.y; } );
+    } );
+    // Entities that wander off are destroyed. That's a structural change, so it's recorded
+    // in a command buffer and played back once every system has finished.
+    scheduler.Add( "cleanup", Reads< Position >(), []( ECS& ecs ) {
+        ecs.ForEach< const Position >( [&]( EntityID e, const Position& p ) {
+            if( p.x > 100 ) ecs.Commands().Destroy( e );
+        } );
+    } );
+
+    // The game loop would call this once per frame.
+    scheduler.Run( ecs );
+
+    // "ai" and "animation" don't conflict, so they run together. "audio" reads what "ai" writes,
+    // and "physics" writes what "ai" reads, so they both wait for "ai". "cleanup" waits for "physics".
+    for( size_t w = 0; w < scheduler.Waves().size(); ++w ) {
+        std::cout << "Wave " << w << ":";
+        for( size_t s : scheduler.Waves()[w] ) std::cout << ' ' << scheduler.Name( s );
+        std::cout << '\n';
+    }
+
+    return 0;
+}
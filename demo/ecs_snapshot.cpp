@@ -0,0 +1,48 @@
+#include <chrono>
+#include <iostream>
+
+#include "ecs.h"
+#include "snapshot.h"
+
+using namespace ecs;
+
+// Snapshot components must be trivially copyable. Entity IDs are fine.
+struct Position { float x{}, y{}; };
+struct Velocity { float x{}, y{}; };
+struct Parent { EntityID parent; };
+
+int main( int argc, const char* argv[] ) {
+    // Every component type gets a name that identifies it in the file.
+    Snapshot snapshot;
+    snapshot.Register< Position >( "position" );
+    snapshot.Register< Velocity >( "velocity" );
+    snapshot.Register< Parent >( "parent" );
+
+    {
+        ECS ecs;
+        EntityID root = ecs.CreateEntity();
+        ecs.Add<Position>( root );
+        for( int i = 0; i < 100000; ++i ) {
+            EntityID e = ecs.CreateEntity();
+            ecs.Add<Position>( e, float(i), 0.f );
+            if( i % 2 == 0 ) ecs.Add<Velocity>( e, 1.f, 2.f );
+            ecs.Add<Parent>( e, Parent{ root } );
+        }
+        snapshot.Save( ecs, "level.ecs" );
+    }
+
+    // A level load is one file mapping. The columns point straight into it.
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    ECS level;
+    snapshot.Load( level, "level.ecs" );
+    const double ms = std::chrono::duration< double, std::milli >( Clock::now() - start ).count();
+    std::cout << "Loaded " << level.NumEntities() << " entities in " << ms << " ms\n";
+
+    // It's an ordinary ECS from here on.
+    int moving = 0;
+    level.ForEach< Position, const Velocity >( [&]( Position& p, const Velocity& v ) { p.x += v.x; ++moving; } );
+    std::cout << moving << " entities moved\n";
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "ecs.h"
+#include "spatial_grid.h"
+
+using namespace ecs;
+
+struct Position { float x{}, y{}; };
+struct Velocity { float x{}, y{}; };
+// Width and height. Entities without one are points.
+struct Size { float x{}, y{}; };
+struct Pickup {};
+
+int main( int argc, const char* argv[] ) {
+    ECS ecs;
+    std::mt19937 rng( 42 );
+    std::uniform_real_distribution< float > coordinate( -1000, 1000 );
+
+    for( int i = 0; i < 10000; ++i ) {
+        EntityID e = ecs.CreateEntity();
+        ecs.Add<Position>( e, coordinate( rng ), coordinate( rng ) );
+        if( i % 100 == 0 ) ecs.Add<Size>( e, 40.f, 20.f );
+        if( i % 10 == 0 ) ecs.Add<Pickup>( e );
+        else ecs.Add<Velocity>( e, coordinate( rng ) / 1000, coordinate( rng ) / 1000 );
+    }
+    EntityID player = ecs.CreateEntity();
+    ecs.Add<Position>( player );
+
+    // Cells about the size of the usual query radius.
+    SpatialGrid< Position, Size > grid( ecs, 50 );
+
+    for( int frame = 0; frame < 3; ++frame ) {
+        ecs.ForEach< Position, const Velocity >( []( Position& p, const Velocity& v ) { p.x += v.x; p.y += v.y; } );
+        // Only the entities that moved are looked at.
+        grid.Update();
+
+        // Pickups near the player, without looping over every entity.
+        const Position& p = ecs.Get<Position>( player );
+        int pickups = 0;
+        grid.QueryRadius( p.x, p.y, 60, [&]( EntityID e ) { if( ecs.Has<Pickup>( e ) ) ++pickups; } );
+
+        int in_view = 0;
+        grid.QueryAABB( -200, -100, 200, 100, [&]( EntityID ) { ++in_view; } );
+
+        // The nearest entity to the player is the player, so ask for two.
+        std::vector< EntityID > nearest;
+        grid.Nearest( p.x, p.y, 2, nearest );
+
+        std::cout << "Frame " << frame << ": " << pickups << " pickups in reach, " << in_view << " entities in view, nearest is " << nearest.back() << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include <iostream>
+
+#include "ecs.h"
+#include "transform.h"
+
+using namespace ecs;
+
+int main( int argc, const char* argv[] ) {
+    ECS ecs;
+
+    // A sprite rig: a body with an arm, and a hand on the end of the arm.
+    // Each part is placed relative to its parent.
+    EntityID body = ecs.CreateEntity();
+    ecs.Add<LocalTransform>( body, LocalTransform{ 100, 50 } );
+    EntityID arm = ecs.CreateEntity();
+    ecs.Add<LocalTransform>( arm, LocalTransform{ 10, 0 } );
+    ecs.Add<Parent>( arm, Parent{ body } );
+    EntityID hand = ecs.CreateEntity();
+    ecs.Add<LocalTransform>( hand, LocalTransform{ 8, 0 } );
+    ecs.Add<Parent>( hand, Parent{ arm } );
+    // Entities that want the result get a `WorldTransform` component.
+    for( EntityID e : { body, arm, hand } ) ecs.Add<WorldTransform>( e );
+
+    // Lots of other things that don't move.
+    for( int i = 0; i < 10000; ++i ) ecs.Add<LocalTransform>( ecs.CreateEntity(), LocalTransform{ float(i), 0 } );
+
+    TransformHierarchy hierarchy( ecs );
+    hierarchy.Update();
+    std::cout << "First update computed " << hierarchy.NumUpdated() << " world transforms\n";
+
+    // Swing the arm up. Only the arm and the hand need new world transforms.
+    ecs.Get<LocalTransform>( arm ).rotation = 3.14159265f / 2;
+    hierarchy.Update();
+    const WorldTransform& w = ecs.Get<WorldTransform>( hand );
+    std::cout << "Second update computed " << hierarchy.NumUpdated() << "; the hand is now at (" << w.x << ", " << w.y << ")\n";
+
+    return 0;
+}
@@ -1,58 +1,37 @@
 #include <iostream>
-#include <cstdint> // For int64_t
 
-// If you want to use the `EntityID` struct directly as the key for a data structure
-// like an `std::unordered_map` or `std::unordered_set`, use its `.id`.
-// Otherwise, you will have to write additional code to tell the data structure
-// how to hash and compare `EntityID`s. See `docs/entity_get_in_an_unordered_map.txt`
-// for details.
+#include "ecs.h"
 
-// An EntityID struct that stores the actual ID and supports `.Get<Component>()`
-struct EntityID {
-    // The id is a 64-bit integer.
-    typedef int64_t IDType;
-    // Instance variable holding the actual ID, initialized to -1.
-    IDType id{-1};
-    // Construct this object with the actual ID.
-    EntityID( IDType val ) : id(val) {}
-    // We still want the default constructor.
-    EntityID() = default;
-    
-    // This EntityID can convert itself to an int64_t on demand.
-    operator IDType() { return id; }
-    
-    // This EntityID supports `.Get<Component>()`
-    // The definition for this function declaration is below, since it uses the global ECS that hasn't been declared yet.
-    template <typename T>
-    T& Get();
-};
-
-// A fake Entity Component System
-// It always returns the same (static) component.
-struct ECS {
-    template <typename T>
-    T& Get( EntityID ) { static T val{}; return val; }
-};
+using namespace ecs;
 
 // A global variable holding the ECS. This technique also works if the ECS is a member of another global variable.
-inline ECS ecs;
+inline ECS world;
 
 // The implementation of EntityID::Get<Component>() calls the global ECS.
-template <typename T> T& EntityID::Get() { return ecs.Get<T>(*this); }
+template <typename T> T& EntityID::Get() { return world.Get<T>(*this); }
+
+// A component that opts into sparse-set storage.
+// (Local structs can't have static members, so this one lives outside `main()`.)
+struct Selected {
+    static constexpr Storage storage = Storage::SparseSet;
+};
 
 int main(int argc, char *argv[]) {
     using namespace std;
     
     // Make two entities.
-    EntityID a(1);
-    EntityID b(2);
+    EntityID a = world.CreateEntity();
+    EntityID b = world.CreateEntity();
     
     // This works (because of the int constructor, not because of the `operator int()`).
-    b = 3;
+    // Only IDs that came from `CreateEntity()` can be used with the ECS, though.
+    EntityID c;
+    c = 3;
     
     // We can print them out and compare them, since they convert to integers on demand.
     cout << "a: " << a << '\n';
     cout << "b: " << b << '\n';
+    cout << "c: " << c << '\n';
     cout << "a == b: " << (a == b) << '\n';
     cout << "a == a: " << (a == a) << '\n';
     
@@ -71,5 +50,35 @@ int main(int argc, char *argv[]) {
     a.Get<Foo>() = 7;
     cout << "a.Get<Foo>(): " << a.Get<Foo>() << '\n';
     
+    // Each entity has its own Foo.
+    b.Get<Foo>() = 9;
+    cout << "a.Get<Foo>(): " << a.Get<Foo>() << '\n';
+    cout << "b.Get<Foo>(): " << b.Get<Foo>() << '\n';
+    
+    // Entities with the same components share an archetype.
+    // Giving `a` another component moves it to a different one.
+    struct Bar { float weight{}; };
+    a.Get<Bar>().weight = 2.5;
+    cout << "a has Bar: " << world.Has<Bar>( a ) << '\n';
+    cout << "b has Bar: " << world.Has<Bar>( b ) << '\n';
+    cout << "a.Get<Foo>() after moving: " << a.Get<Foo>() << '\n';
+    
+    // Dropping it moves `a` back.
+    world.Drop<Bar>( a );
+    cout << "a has Bar after Drop: " << world.Has<Bar>( a ) << '\n';
+    
+    // Components that come and go often can live in a sparse set instead.
+    // Adding and dropping them doesn't move the entity's other components.
+    b.Get<Selected>();
+    cout << "b is selected: " << world.Has<Selected>( b ) << '\n';
+    world.Drop<Selected>( b );
+    cout << "b is selected after Drop: " << world.Has<Selected>( b ) << '\n';
+    
+    // Destroyed entities' slots get recycled with a new generation.
+    // A copy of a destroyed ID is stale, and the ECS knows it.
+    EntityID old = b;
+    world.Destroy( b );
+    cout << "old b is alive: " << world.Alive( old ) << '\n';
+    
     return 0;
 }
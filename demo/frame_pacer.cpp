@@ -0,0 +1,34 @@
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+#include "frame_pacer.h"
+
+// A fixed-timestep loop, compared to the single `sleep_for()` in `chrono_sleep_for.cpp`.
+int main(int argc, char *argv[]) {
+    using namespace std::chrono;
+    
+    // 100 ticks per second.
+    timing::FramePacer pacer( 0.01 );
+    
+    double x = 0;
+    double worst = 0;
+    auto last = steady_clock::now();
+    for( int frame = 0; frame < 200; ++frame ) {
+        // Simulate in fixed steps.
+        for( int i = pacer.Advance(); i > 0; --i ) {
+            x += 1.0 * pacer.Step();
+        }
+        // A renderer would draw at `previous + pacer.Alpha() * (current - previous)`.
+        
+        pacer.WaitForNextTick();
+        
+        // How far was this tick from 10 ms after the last one?
+        const auto now = steady_clock::now();
+        if( frame > 0 ) worst = std::max( worst, std::abs( duration<double>( now - last ).count() - pacer.Step() ) );
+        last = now;
+    }
+    
+    std::cout << "Simulated " << x << " seconds.\n";
+    std::cout << "Worst tick jitter: " << worst*1e6 << " microseconds.\n";
+}
@@ -0,0 +1,24 @@
+#include <iostream>
+
+#include "bytecode_cache.h"
+
+// Run this from the repository root (like `paths`), so it can find `data/`.
+// The first run compiles `data/hello.lua` and writes `data/hello.lua.luac`.
+// Later runs load the bytecode and skip parsing, until the script changes.
+int main(int argc, char *argv[]) {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+
+    scripting::BytecodeCache cache( lua );
+
+    sol::load_result loaded = cache.LoadFile( "data/hello.lua" );
+    if( !loaded.valid() ) {
+        std::cerr << "Failed to load script: " << sol::error(loaded).what() << std::endl;
+        return -1;
+    }
+
+    sol::protected_function f = loaded;
+    f( "cats" );
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <iostream>
+
+#include "ecs.h"
+#include "lua_ecs.h"
+
+using namespace ecs;
+
+struct Position { float x{}, y{}; };
+struct Velocity { float x{}, y{}; };
+
+int main(int argc, char *argv[]) {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+
+    ECS ecs;
+    LuaECS luaECS( lua, ecs );
+
+    // C++ components need to be usertypes first.
+    lua.new_usertype<Position>( "Position", "x", &Position::x, "y", &Position::y );
+    lua.new_usertype<Velocity>( "Velocity", "x", &Velocity::x, "y", &Velocity::y );
+    luaECS.RegisterComponent<Position>( "position" );
+    luaECS.RegisterComponent<Velocity>( "velocity" );
+
+    // The script uses the same syntax as the Lua ECS sketch.
+    // `position` and `velocity` live in the C++ ECS. `health` is Lua-only.
+    auto result = lua.safe_script( R"(
+        for i = 1, 3 do
+            local e = ECS.CreateEntity()
+            ECS.Components.position[e] = { x = i, y = 0 }
+            ECS.Components.velocity[e] = { x = 1, y = 2 }
+            ECS.Components.health[e] = 100
+        end
+
+        -- Looking components up by ID instead of by name skips hashing the name every time.
+        local position = ECS.ComponentID( "position" )
+        local velocity = ECS.ComponentID( "velocity" )
+        ECS.ForEach( { position, velocity }, function( e )
+            local p = ECS.Components[position][e]
+            local v = ECS.Components[velocity][e]
+            p.x = p.x + v.x * 0.5
+            p.y = p.y + v.y * 0.5
+        end )
+    )", sol::script_pass_on_error );
+    if( !result.valid() ) {
+        std::cerr << "Script failed: " << sol::error(result).what() << std::endl;
+        return -1;
+    }
+
+    // C++ sees the same data.
+    EntityID first;
+    ecs.ForEach< const Position >( [&]( EntityID e, const Position& p ) {
+        std::cout << "Entity " << e << " is at (" << p.x << ", " << p.y << ")\n";
+        if( !first.Valid() ) first = e;
+    } );
+
+    // C++ can destroy entities too. Lua stops seeing them, even their Lua-only components,
+    // and destroying one again from Lua does nothing.
+    ecs.Destroy( first );
+    lua["gone"] = first.id;
+    result = lua.safe_script( R"(
+        local count = 0
+        ECS.ForEach( { "health" }, function( e )
+            assert( e ~= gone, "ForEach visited a destroyed entity" )
+            count = count + 1
+        end )
+        assert( count == 2 and #ECS.Components.health == 2 )
+        assert( ECS.Components.health[gone] == nil and ECS.Components.position[gone] == nil )
+        ECS.DestroyEntity( gone )
+
+        -- The new entity may reuse the destroyed one's index.
+        local e = ECS.CreateEntity()
+        ECS.Components.health[e] = 50
+        ECS.DestroyEntity( e )
+        ECS.DestroyEntity( e )
+        assert( #ECS.Components.health == 2 )
+    )", sol::script_pass_on_error );
+    if( !result.valid() ) {
+        std::cerr << "Script failed: " << sol::error(result).what() << std::endl;
+        return -1;
+    }
+    std::cout << "Lua no longer sees entity " << first << '\n';
+
+    return 0;
+}
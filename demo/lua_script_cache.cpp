@@ -0,0 +1,69 @@
+#include <iostream>
+
+#include "ecs.h"
+#include "script_cache.h"
+
+using namespace ecs;
+using namespace scripting;
+
+// A component that says which script an entity runs every frame.
+// It holds a handle, not a name, so dispatch doesn't hash any strings.
+struct Script {
+    ScriptHandle handle = InvalidHandle;
+};
+
+int main(int argc, char *argv[]) {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+
+    ScriptCache scripts( lua );
+    // Every script run is measured, as "[script] wander" and so on.
+    Profiler profiler;
+    scripts.SetProfiler( &profiler );
+
+    // Look the scripts up once, when loading.
+    const LoadResult wander = scripts.LoadScriptString( "wander", R"(
+        local e, frame = ...
+        if frame == 0 then print( "entity " .. e .. " wanders" ) end
+    )" );
+    const LoadResult guard = scripts.LoadScriptString( "guard", R"(
+        local e, frame = ...
+        if frame == 0 then print( "entity " .. e .. " guards" ) end
+    )" );
+    // A script that doesn't compile gets an invalid handle. Running it just returns an error.
+    const LoadResult broken = scripts.LoadScriptString( "broken", "this isn't lua" );
+    if( !broken.valid() ) std::cerr << broken.error << '\n';
+
+    ECS ecs;
+    ecs.Add<Script>( ecs.CreateEntity(), broken.handle );
+    for( int i = 0; i < 4; ++i ) {
+        ecs.Add<Script>( ecs.CreateEntity(), i % 2 == 0 ? wander.handle : guard.handle );
+    }
+
+    for( int frame = 0; frame < 3; ++frame ) {
+        ecs.ForEach< const Script >( [&]( EntityID e, const Script& s ) {
+            auto result = scripts.Run( s.handle, e.id, frame );
+            if( !result.valid() ) std::cerr << sol::error(result).what() << '\n';
+        } );
+        profiler.EndFrame();
+
+        // Reloading keeps the handle, so entities pick up the new code.
+        if( frame == 0 ) {
+            scripts.LoadScriptString( "guard", R"(
+                local e, frame = ...
+                if frame == 1 then print( "entity " .. e .. " guards harder" ) end
+            )" );
+        }
+    }
+
+    // Lua globals can be cached too. The lookup happens once (and again after a reloaded script runs).
+    lua.script( "function Greet( name ) print( 'hello ' .. name ) end" );
+    scripts.Invalidate();
+    const FunctionHandle greet = scripts.FindFunction( "Greet" );
+    scripts.Call( greet, "cats" );
+    scripts.Call( greet, "dogs" );
+
+    profiler.WriteCSV( std::cout );
+
+    return 0;
+}
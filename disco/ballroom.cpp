@@ -1,9 +1,68 @@
 #include "ballroom.h"
 
+#include <atomic>
+#include <stdexcept>
+
 namespace disco {
 
+Party::Party() : mInboxes( std::make_unique< Inbox[] >( NumInboxes ) ) {}
+
+// Only the committed state comes along. Each party keeps its own inboxes.
+Party::Party( const Party& other ) : Party() { *this = other; }
+Party::Party( Party&& other ) : Party() { *this = std::move( other ); }
+Party& Party::operator=( const Party& other ) {
+    mDancers = other.mDancers;
+    mVersion = other.mVersion;
+    mIndex = other.mIndex;
+    mIndexBits = other.mIndexBits;
+    mNumNames = other.mNumNames;
+    mNextSameName = other.mNextSameName;
+    mPreviousSameName = other.mPreviousSameName;
+    // Snapshots never change, so they can be shared.
+    mSnapshot = other.mSnapshot;
+    std::shared_ptr< const Snapshot::Frozen > published = other.Published().mFrozen;
+    std::lock_guard< std::mutex > lock( mPublishedMutex );
+    mPublished = std::move( published );
+    return *this;
+}
+Party& Party::operator=( Party&& other ) {
+    if( this == &other ) return *this;
+    mDancers = std::move( other.mDancers );
+    mVersion = other.mVersion;
+    mIndex = std::move( other.mIndex );
+    mIndexBits = other.mIndexBits;
+    mNumNames = other.mNumNames;
+    mNextSameName = std::move( other.mNextSameName );
+    mPreviousSameName = std::move( other.mPreviousSameName );
+    mSnapshot = std::move( other.mSnapshot );
+    std::shared_ptr< const Snapshot::Frozen > published;
+    {
+        std::lock_guard< std::mutex > lock( other.mPublishedMutex );
+        published.swap( other.mPublished );
+    }
+    {
+        std::lock_guard< std::mutex > lock( mPublishedMutex );
+        mPublished.swap( published );
+    }
+    // Leave `other` an empty party, with its index to match.
+    other.mDancers.clear();
+    other.mIndex.clear();
+    other.mIndexBits = 0;
+    other.mNumNames = 0;
+    other.mNextSameName.clear();
+    other.mPreviousSameName.clear();
+    return *this;
+}
+
 void Party::AddDancer( const Dancer& d ) {
     mDancers.push_back( d );
+    Indexed();
+    ++mVersion;
+}
+void Party::AddDancer( Dancer&& d ) {
+    mDancers.push_back( std::move( d ) );
+    Indexed();
+    ++mVersion;
 }
 Party::PartyGoers Party::WhoIsAtThisParty() const {
     // Declare our output
@@ -13,10 +72,174 @@ Party::PartyGoers Party::WhoIsAtThisParty() const {
     // Iterate over the dancers
     for( const auto& d : mDancers ) {
         // Add their names to the result
-        result.push_back( d.name );
+        result.emplace_back( d.Name() );
     }
     
     return result;
 }
 
+std::shared_ptr< const Party::Snapshot::Frozen > Party::Freeze() const {
+    if( !mSnapshot || mSnapshot->version != mVersion ) {
+        mSnapshot = std::make_shared< const Snapshot::Frozen >( Snapshot::Frozen{ mDancers, mVersion } );
+    }
+    return mSnapshot;
+}
+
+void Party::Submit( const Dancer& d ) {
+    // Threads are numbered as they first submit to any party (see `mInboxes`).
+    static std::atomic< size_t > next_thread{ 0 };
+    thread_local const size_t thread = next_thread.fetch_add( 1, std::memory_order_relaxed );
+
+    Inbox& inbox = mInboxes[ thread % NumInboxes ];
+    std::lock_guard< std::mutex > lock( inbox.mutex );
+    inbox.dancers.push_back( d );
+}
+
+size_t Party::Commit() {
+    size_t added = 0;
+    for( size_t i = 0; i < NumInboxes; ++i ) {
+        Inbox& inbox = mInboxes[i];
+        {
+            // Hold the lock just long enough to take the inbox's dancers, so the thread that
+            // uses it can keep submitting while they're added.
+            std::lock_guard< std::mutex > lock( inbox.mutex );
+            if( inbox.dancers.empty() ) continue;
+            mIncoming.swap( inbox.dancers );
+        }
+        added += mIncoming.size();
+        AddDancers( mIncoming );
+        mIncoming.clear();
+    }
+    // Nothing new, and the party hasn't changed since the last publish: don't copy the roster again.
+    if( added == 0 && Published().Version() == mVersion ) return 0;
+    std::shared_ptr< const Snapshot::Frozen > frozen = Freeze();
+    {
+        std::lock_guard< std::mutex > lock( mPublishedMutex );
+        mPublished.swap( frozen );
+    }
+    // The old one (in `frozen` now) is let go of outside the lock.
+    return added;
+}
+
+Party::Snapshot Party::Published() const {
+    std::lock_guard< std::mutex > lock( mPublishedMutex );
+    return Snapshot( mPublished );
+}
+
+const Dancer* Party::Find( const Dancer& d ) const {
+    const uint32_t slot = Slot( d.name_id );
+    return slot == Empty ? nullptr : &mDancers[ mIndex[ slot ].first ];
+}
+const Dancer* Party::Find( string_view name ) const {
+    // A name that was never interned can't be anyone's.
+    const std::optional< Symbol > symbol = NameTable::Global().Find( name );
+    const uint32_t slot = symbol ? Slot( *symbol ) : Empty;
+    return slot == Empty ? nullptr : &mDancers[ mIndex[ slot ].first ];
+}
+
+bool Party::RemoveDancer( const Dancer& d ) {
+    const uint32_t slot = Slot( d.name_id );
+    if( slot == Empty ) return false;
+    RemoveFirst( slot );
+    return true;
+}
+bool Party::RemoveDancer( string_view name ) {
+    const std::optional< Symbol > symbol = NameTable::Global().Find( name );
+    const uint32_t slot = symbol ? Slot( *symbol ) : Empty;
+    if( slot == Empty ) return false;
+    RemoveFirst( slot );
+    return true;
+}
+
+void Party::RemoveFirst( uint32_t slot ) {
+    // Take them off the front of their name's list.
+    const uint32_t position = mIndex[ slot ].first;
+    const uint32_t next = mNextSameName[ position ];
+    if( next == Empty ) {
+        EraseSlot( slot );
+    } else {
+        mIndex[ slot ].first = next;
+        mPreviousSameName[ next ] = Empty;
+    }
+
+    // Swap and pop. Whoever was last takes over the position, in the list and the index.
+    const uint32_t last = uint32_t( mDancers.size() - 1 );
+    if( position != last ) {
+        mDancers[ position ] = mDancers[ last ];
+        const uint32_t previous = mPreviousSameName[ last ];
+        mNextSameName[ position ] = mNextSameName[ last ];
+        mPreviousSameName[ position ] = previous;
+        if( previous == Empty ) mIndex[ Slot( mDancers[ position ].name_id ) ].first = position;
+        else mNextSameName[ previous ] = position;
+        if( mNextSameName[ position ] != Empty ) mPreviousSameName[ mNextSameName[ position ] ] = position;
+    }
+    mDancers.pop_back();
+    mNextSameName.pop_back();
+    mPreviousSameName.pop_back();
+    ++mVersion;
+}
+
+void Party::EraseSlot( uint32_t slot ) {
+    // Pull back any later slots in the same run that would have used this one.
+    const size_t mask = mIndex.size() - 1;
+    for( size_t next = ( slot + 1 ) & mask; mIndex[ next ].first != Empty; next = ( next + 1 ) & mask ) {
+        // `next` can fill the hole if the hole is between its home and it.
+        const size_t home = Home( mIndex[ next ].name );
+        if( ( ( next - home ) & mask ) >= ( ( next - slot ) & mask ) ) {
+            mIndex[ slot ] = mIndex[ next ];
+            slot = uint32_t( next );
+        }
+    }
+    mIndex[ slot ].first = Empty;
+    --mNumNames;
+}
+
+void Party::Indexed() {
+    if( mDancers.size() > UINT32_MAX - 1 ) throw std::length_error( "Party: too many dancers" );
+    const uint32_t position = uint32_t( mDancers.size() - 1 );
+    const Symbol name = mDancers.back().name_id;
+    mNextSameName.push_back( Empty );
+    mPreviousSameName.push_back( Empty );
+
+    // Someone already has the name, so go to the front of their list.
+    const uint32_t slot = Slot( name );
+    if( slot != Empty ) {
+        const uint32_t first = mIndex[ slot ].first;
+        mNextSameName[ position ] = first;
+        mPreviousSameName[ first ] = position;
+        mIndex[ slot ].first = position;
+        return;
+    }
+
+    if( 2*( mNumNames + 1 ) > mIndex.size() ) GrowIndex();
+    const size_t mask = mIndex.size() - 1;
+    size_t free = Home( name );
+    while( mIndex[ free ].first != Empty ) free = ( free + 1 ) & mask;
+    mIndex[ free ] = IndexSlot{ name, position };
+    ++mNumNames;
+}
+
+void Party::GrowIndex() {
+    vector< IndexSlot > old( size_t( 1 ) << std::max< uint32_t >( mIndexBits + 1, 4 ), IndexSlot{ NameTable::Empty, Empty } );
+    old.swap( mIndex );
+    mIndexBits = std::max< uint32_t >( mIndexBits + 1, 4 );
+
+    const size_t mask = mIndex.size() - 1;
+    for( const IndexSlot& s : old ) {
+        if( s.first == Empty ) continue;
+        size_t slot = Home( s.name );
+        while( mIndex[ slot ].first != Empty ) slot = ( slot + 1 ) & mask;
+        mIndex[ slot ] = s;
+    }
+}
+
+uint32_t Party::Slot( Symbol name ) const {
+    if( mIndex.empty() ) return Empty;
+    const size_t mask = mIndex.size() - 1;
+    for( size_t slot = Home( name ); mIndex[ slot ].first != Empty; slot = ( slot + 1 ) & mask ) {
+        if( mIndex[ slot ].name == name ) return uint32_t( slot );
+    }
+    return Empty;
+}
+
 }
@@ -3,18 +3,250 @@
 #include "types.h"
 #include "dancer.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
 namespace disco {
 
 struct Dancer;
 
+// The names of a list of dancers, looked at in place instead of copied.
+// Like an iterator, it's only good until the dancers change.
+class RosterView {
+public:
+    class iterator {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef string_view value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef string_view reference;
+        // Names are made on the fly, so `->` hands out a name held by value.
+        struct pointer {
+            string_view name;
+            const string_view* operator->() const { return &name; }
+        };
+
+        iterator() = default;
+        explicit iterator( const Dancer* d ) : mDancer( d ) {}
+
+        string_view operator*() const { return mDancer->Name(); }
+        pointer operator->() const { return pointer{ mDancer->Name() }; }
+        string_view operator[]( difference_type i ) const { return mDancer[i].Name(); }
+        iterator& operator++() { ++mDancer; return *this; }
+        iterator operator++( int ) { iterator old = *this; ++mDancer; return old; }
+        iterator& operator--() { --mDancer; return *this; }
+        iterator operator--( int ) { iterator old = *this; --mDancer; return old; }
+        iterator& operator+=( difference_type n ) { mDancer += n; return *this; }
+        iterator& operator-=( difference_type n ) { mDancer -= n; return *this; }
+        iterator operator+( difference_type n ) const { return iterator( mDancer + n ); }
+        friend iterator operator+( difference_type n, const iterator& it ) { return it + n; }
+        iterator operator-( difference_type n ) const { return iterator( mDancer - n ); }
+        difference_type operator-( const iterator& other ) const { return mDancer - other.mDancer; }
+        bool operator==( const iterator& other ) const { return mDancer == other.mDancer; }
+        bool operator!=( const iterator& other ) const { return mDancer != other.mDancer; }
+        bool operator<( const iterator& other ) const { return mDancer < other.mDancer; }
+        bool operator>( const iterator& other ) const { return mDancer > other.mDancer; }
+        bool operator<=( const iterator& other ) const { return mDancer <= other.mDancer; }
+        bool operator>=( const iterator& other ) const { return mDancer >= other.mDancer; }
+
+    private:
+        const Dancer* mDancer = nullptr;
+    };
+
+    RosterView() = default;
+    RosterView( const Dancer* first, size_t count ) : mFirst( first ), mCount( count ) {}
+
+    iterator begin() const { return iterator( mFirst ); }
+    iterator end() const { return iterator( mFirst + mCount ); }
+    size_t size() const { return mCount; }
+    bool empty() const { return mCount == 0; }
+    string_view operator[]( size_t i ) const { return mFirst[i].Name(); }
+
+private:
+    const Dancer* mFirst = nullptr;
+    size_t mCount = 0;
+};
+
+// A party is owned by one thread, which is the only one that may call anything on it,
+// except for the few calls marked as safe from any thread.
+//
+// Other threads can send dancers in with `Submit()`, which only waits for the owner (and only
+// while it's collecting them), never for other submitting threads. Submitted dancers show up
+// when the owner calls `Commit()`, all at once. Readers on other threads look at
+// `Published()`, the party as of the last `Commit()`.
+//
+//     // Any number of gateway threads:
+//     party.Submit( name );
+//     // The owner, once a tick:
+//     party.Commit();
+//     // Any number of dashboard threads:
+//     for( string_view name : party.Published().Roster() ) ...
+//
+// Copying or moving a party takes the dancers it has committed. Dancers submitted
+// but not yet committed stay behind with the original, and the new party starts
+// with empty inboxes.
 class Party {
 public:
+    Party();
+    Party( const Party& other );
+    Party( Party&& other );
+    Party& operator=( const Party& other );
+    Party& operator=( Party&& other );
+
     void AddDancer( const Dancer& d );
+    void AddDancer( Dancer&& d );
+    // Makes the dancer right in the party, from anything a `Dancer` can be made from.
+    template< typename... Args >
+    void EmplaceDancer( Args&&... args ) {
+        mDancers.emplace_back( std::forward< Args >( args )... );
+        Indexed();
+        ++mVersion;
+    }
+    // Adds every dancer (or name) in `dancers`, making room for them all at once.
+    //     party.AddDancers( guest_list );
+    template< typename Range >
+    void AddDancers( Range&& dancers );
+
     typedef vector< string > PartyGoers;
     PartyGoers WhoIsAtThisParty() const;
-    
+
+    // Looking dancers up by name doesn't search the whole party; there's a hash index.
+    // If several dancers share a name, these find any one of them.
+    bool Contains( const Dancer& d ) const { return Find( d ) != nullptr; }
+    bool Contains( string_view name ) const { return Find( name ) != nullptr; }
+    // nullptr if there's no one by that name. Only good until the next change to the party.
+    const Dancer* Find( const Dancer& d ) const;
+    const Dancer* Find( string_view name ) const;
+    // Sends one dancer by that name home. Returns false if there was no one by that name.
+    // The last dancer takes their place, so this changes the order of the roster.
+    bool RemoveDancer( const Dancer& d );
+    bool RemoveDancer( string_view name );
+
+    // Who is here right now, without copying anyone's name.
+    // Only good until the next change to the party.
+    RosterView Roster() const { return RosterView( mDancers.data(), mDancers.size() ); }
+
+    // Goes up by one with every change to the party.
+    uint64_t Version() const { return mVersion; }
+
+    // Who was here at some version of the party. Stays valid (and unchanged)
+    // however the party changes afterwards, and can be passed to other threads.
+    class Snapshot {
+    public:
+        Snapshot() = default;
+        RosterView Roster() const { return mFrozen ? RosterView( mFrozen->dancers.data(), mFrozen->dancers.size() ) : RosterView(); }
+        uint64_t Version() const { return mFrozen ? mFrozen->version : 0; }
+
+    private:
+        friend class Party;
+        struct Frozen {
+            vector< Dancer > dancers;
+            uint64_t version;
+        };
+        explicit Snapshot( std::shared_ptr< const Frozen > frozen ) : mFrozen( std::move( frozen ) ) {}
+
+        std::shared_ptr< const Frozen > mFrozen;
+    };
+    // The dancers are only copied the first time a snapshot of a new version is taken.
+    // Taking another before the party changes just shares that copy.
+    Snapshot TakeSnapshot() const { return Snapshot( Freeze() ); }
+
+    // Safe from any thread. Adds a dancer at the next `Commit()`.
+    void Submit( const Dancer& d );
+    void Submit( string_view name ) { Submit( Dancer( name ) ); }
+    // Adds everyone submitted so far, then publishes the party. Returns how many were added.
+    // Publishing copies the roster (once), so commit in batches, not after every dancer.
+    size_t Commit();
+    // Safe from any thread. The party as of the last `Commit()`. Only waits for a `Commit()`
+    // that is swapping in a new one, never for the owner's other work.
+    Snapshot Published() const;
+
 private:
+    static constexpr uint32_t Empty = UINT32_MAX;
+
+    // Adds the last dancer to the index.
+    void Indexed();
+    // Sends home the first dancer in the slot's list.
+    void RemoveFirst( uint32_t slot );
+    // Empties a slot, moving later slots back so every search still finds what it's looking for.
+    void EraseSlot( uint32_t slot );
+    void GrowIndex();
+    // Where a name's search through the index starts.
+    size_t Home( Symbol name ) const { return size_t( uint32_t( name * 0x9E3779B9u ) >> ( 32 - mIndexBits ) ); }
+    // The index slot for `name`, or Empty if no one here has it.
+    uint32_t Slot( Symbol name ) const;
+
     vector< Dancer > mDancers;
+    uint64_t mVersion = 0;
+
+    // The name index: open addressing with linear probing, at most half full.
+    // There's one slot per name, however many dancers share it, so a popular name doesn't
+    // make a long run of slots. Each slot has the name and the position in `mDancers`
+    // of the first dancer by that name (Empty if the slot is free).
+    struct IndexSlot {
+        Symbol name;
+        uint32_t first;
+    };
+    vector< IndexSlot > mIndex;
+    uint32_t mIndexBits = 0;
+    size_t mNumNames = 0;
+    // Everyone else by the same name is in a list, linked by these. Both match `mDancers`.
+    vector< uint32_t > mNextSameName;
+    vector< uint32_t > mPreviousSameName;
+
+    // A snapshot of the party as it is now, reusing the last one if nothing's changed.
+    std::shared_ptr< const Snapshot::Frozen > Freeze() const;
+
+    // The most recent snapshot.
+    mutable std::shared_ptr< const Snapshot::Frozen > mSnapshot;
+    // The last one `Commit()` published. The lock is only held to copy or swap the pointer.
+    std::shared_ptr< const Snapshot::Frozen > mPublished;
+    mutable std::mutex mPublishedMutex;
+
+    // Submitted dancers wait here. Threads are numbered once for the whole program, and a
+    // thread uses the inbox for its number in every party. So the first `NumInboxes` threads
+    // that ever submit each have an inbox to themselves; later ones share, which only means
+    // they may wait for each other.
+    struct alignas( 64 ) Inbox {
+        std::mutex mutex;
+        vector< Dancer > dancers;
+    };
+    static constexpr size_t NumInboxes = 64;
+    std::unique_ptr< Inbox[] > mInboxes;
+    // What `Commit()` swaps into an inbox in exchange for its dancers.
+    vector< Dancer > mIncoming;
 };
 
+template< typename Range >
+void Party::AddDancers( Range&& dancers ) {
+    using std::begin;
+    using std::end;
+    auto first = begin( dancers );
+    auto last = end( dancers );
+
+    // A single pass can't be counted ahead of time, so only reserve when it can go around twice.
+    typedef typename std::iterator_traits< decltype( first ) >::iterator_category category;
+    if constexpr( std::is_base_of_v< std::forward_iterator_tag, category > ) {
+        const size_t needed = mDancers.size() + size_t( std::distance( first, last ) );
+        // Still grow geometrically, so many small batches don't reallocate every time.
+        if( needed > mDancers.capacity() ) {
+            const size_t capacity = std::max( needed, 2*mDancers.capacity() );
+            mDancers.reserve( capacity );
+            mNextSameName.reserve( capacity );
+            mPreviousSameName.reserve( capacity );
+        }
+    }
+    for( ; first != last; ++first ) {
+        mDancers.emplace_back( *first );
+        Indexed();
+    }
+    ++mVersion;
+}
+
 }
@@ -1,14 +1,30 @@
 #pragma once
 
-#include <string>
+#include "names.h"
+
+#include <cstddef>
+#include <functional>
 
 namespace disco {
 
+// A dancer's name is a symbol in `NameTable::Global()`, so a million dancers called
+// "cat" share one copy of "cat", and comparing or hashing dancers compares numbers.
 struct Dancer {
-    std::string name;
+    Symbol name_id = NameTable::Empty;
     
     Dancer() = default;
-    Dancer( const std::string& n ) { name = n; }
+    Dancer( string_view n ) : name_id( NameTable::Global().Intern( n ) ) {}
+    
+    string_view Name() const { return NameTable::Global().Name( name_id ); }
+    
+    bool operator==( const Dancer& other ) const { return name_id == other.name_id; }
+    bool operator!=( const Dancer& other ) const { return name_id != other.name_id; }
 };
 
 }
+
+namespace std {
+template<> struct hash< disco::Dancer > {
+    size_t operator()( const disco::Dancer& d ) const { return hash< disco::Symbol >()( d.name_id ); }
+};
+}
@@ -0,0 +1,126 @@
+#include "names.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace disco {
+
+NameTable::NameTable() {
+    for( Shard& shard : mShards ) {
+        shard.symbols.assign( 64, 0 );
+        shard.hashes.assign( 64, 0 );
+    }
+    // The empty name is found without looking, so it isn't in any shard.
+    Append( string_view() );
+}
+
+Symbol NameTable::Intern( string_view name ) {
+    if( name.empty() ) return Empty;
+    const uint32_t hash = Hash( name );
+
+    Shard& shard = ShardOf( hash );
+    std::lock_guard< std::mutex > lock( shard.mutex );
+    Symbol symbol;
+    if( Lookup( shard, name, hash, symbol ) ) return symbol;
+    symbol = Append( name );
+    Insert( shard, symbol, hash );
+    return symbol;
+}
+
+std::optional< Symbol > NameTable::Find( string_view name ) const {
+    if( name.empty() ) return Empty;
+    const uint32_t hash = Hash( name );
+
+    const Shard& shard = ShardOf( hash );
+    std::lock_guard< std::mutex > lock( shard.mutex );
+    Symbol symbol;
+    if( Lookup( shard, name, hash, symbol ) ) return symbol;
+    return std::nullopt;
+}
+
+bool NameTable::Lookup( const Shard& shard, string_view name, uint32_t hash, Symbol& symbol ) const {
+    const size_t mask = shard.symbols.size() - 1;
+    for( size_t slot = hash & mask; shard.symbols[ slot ] != 0; slot = ( slot + 1 ) & mask ) {
+        symbol = shard.symbols[ slot ] - 1;
+        if( shard.hashes[ slot ] == hash && Name( symbol ) == name ) return true;
+    }
+    return false;
+}
+
+void NameTable::Insert( Shard& shard, Symbol symbol, uint32_t hash ) {
+    if( 2*( shard.size + 1 ) > shard.symbols.size() ) {
+        vector< uint32_t > symbols( 2*shard.symbols.size(), 0 );
+        vector< uint32_t > hashes( 2*shard.hashes.size(), 0 );
+        const size_t mask = symbols.size() - 1;
+        for( size_t i = 0; i < shard.symbols.size(); ++i ) {
+            if( shard.symbols[i] == 0 ) continue;
+            size_t slot = shard.hashes[i] & mask;
+            while( symbols[ slot ] != 0 ) slot = ( slot + 1 ) & mask;
+            symbols[ slot ] = shard.symbols[i];
+            hashes[ slot ] = shard.hashes[i];
+        }
+        shard.symbols.swap( symbols );
+        shard.hashes.swap( hashes );
+    }
+    const size_t mask = shard.symbols.size() - 1;
+    size_t slot = hash & mask;
+    while( shard.symbols[ slot ] != 0 ) slot = ( slot + 1 ) & mask;
+    shard.symbols[ slot ] = symbol + 1;
+    shard.hashes[ slot ] = hash;
+    ++shard.size;
+}
+
+Symbol NameTable::Append( string_view name ) {
+    std::lock_guard< std::mutex > lock( mAppendMutex );
+    const size_t size = mSize.load( std::memory_order_relaxed );
+    if( size > UINT32_MAX - 1 ) throw std::length_error( "NameTable: out of symbols" );
+    const Symbol symbol = Symbol( size );
+
+    if( ( symbol >> PageBits ) >= mPageStorage.size() ) {
+        // Out of pages. Is the directory full too?
+        if( mPageStorage.size() == mDirectoryCapacity ) {
+            const size_t capacity = std::max< size_t >( 16, 2*mDirectoryCapacity );
+            std::unique_ptr< Page*[] > directory( new Page*[ capacity ]() );
+            for( size_t i = 0; i < mPageStorage.size(); ++i ) directory[i] = mPageStorage[i].get();
+            mDirectoryCapacity = capacity;
+            mPages.store( directory.get(), std::memory_order_release );
+            mDirectories.push_back( std::move( directory ) );
+        }
+        mPageStorage.push_back( std::make_unique< Page >() );
+        mDirectories.back()[ mPageStorage.size()-1 ] = mPageStorage.back().get();
+    }
+    mPageStorage[ symbol >> PageBits ]->names[ symbol & PageMask ] = Store( name );
+
+    mSize.store( size + 1, std::memory_order_release );
+    return symbol;
+}
+
+string_view NameTable::Store( string_view name ) {
+    if( name.empty() ) return string_view();
+    if( name.size() > mLeft ) {
+        // Long names get a block of their own, so they don't waste the rest of the current one.
+        // `mCursor` keeps pointing into the current one.
+        if( name.size() > BlockSize/4 ) {
+            mBlocks.push_back( std::make_unique< char[] >( name.size() ) );
+            std::memcpy( mBlocks.back().get(), name.data(), name.size() );
+            return string_view( mBlocks.back().get(), name.size() );
+        }
+        mBlocks.push_back( std::make_unique< char[] >( BlockSize ) );
+        mCursor = mBlocks.back().get();
+        mLeft = BlockSize;
+    }
+    std::memcpy( mCursor, name.data(), name.size() );
+    const string_view stored( mCursor, name.size() );
+    mCursor += name.size();
+    mLeft -= name.size();
+    return stored;
+}
+
+uint32_t NameTable::Hash( string_view name ) {
+    const uint64_t h = std::hash< string_view >()( name );
+    return uint32_t( h ^ ( h >> 32 ) );
+}
+
+}
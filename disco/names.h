@@ -0,0 +1,106 @@
+#pragma once
+
+#include "types.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+namespace disco {
+
+// A name stored once in a `NameTable`. Two symbols from the same table are equal
+// exactly when their names are.
+typedef uint32_t Symbol;
+
+// Keeps one copy of every distinct name, packed together in big blocks, and hands out
+// a small number for each. Names are never removed, so the numbers and the
+// `string_view`s of the names stay good for as long as the table lives.
+//
+// `Intern()` and `Find()` can be called from any number of threads. The index is split into
+// shards by hash, each with its own lock, so threads looking up different names rarely wait
+// for each other. Only adding a new name takes a lock that everyone shares.
+// `Name()` never waits: the pages of names only ever get added, never move.
+class NameTable {
+public:
+    // The empty name, which every table starts with.
+    static constexpr Symbol Empty = 0;
+
+    NameTable();
+    NameTable( const NameTable& ) = delete;
+    NameTable& operator=( const NameTable& ) = delete;
+
+    // The symbol for `name`, adding it if it's new.
+    Symbol Intern( string_view name );
+    // The symbol for `name`, if it's been interned. Never adds it.
+    std::optional< Symbol > Find( string_view name ) const;
+
+    string_view Name( Symbol symbol ) const {
+        Page* const* pages = mPages.load( std::memory_order_acquire );
+        return pages[ symbol >> PageBits ]->names[ symbol & PageMask ];
+    }
+
+    // How many distinct names there are.
+    size_t Size() const { return mSize.load( std::memory_order_acquire ); }
+
+    // The table that `Dancer`s use.
+    static NameTable& Global() {
+        static NameTable table;
+        return table;
+    }
+
+private:
+    static constexpr uint32_t PageBits = 10;
+    static constexpr uint32_t PageSize = 1 << PageBits;
+    static constexpr uint32_t PageMask = PageSize - 1;
+    static constexpr size_t BlockSize = 64*1024;
+
+    struct Page {
+        string_view names[ PageSize ];
+    };
+
+    // Copies the characters into the current block (or a new one).
+    string_view Store( string_view name );
+    // Open addressing, linear probing, at most half full. Each slot has a symbol plus one
+    // (0 if the slot is empty) and its name's hash, so probing and growing don't rehash names.
+    struct alignas( 64 ) Shard {
+        mutable std::mutex mutex;
+        vector< uint32_t > symbols;
+        vector< uint32_t > hashes;
+        size_t size = 0;
+    };
+    static constexpr uint32_t ShardBits = 4;
+
+    // The low bits of the hash pick the slot, the high bits the shard.
+    Shard& ShardOf( uint32_t hash ) { return mShards[ hash >> ( 32 - ShardBits ) ]; }
+    const Shard& ShardOf( uint32_t hash ) const { return mShards[ hash >> ( 32 - ShardBits ) ]; }
+    // Looks `name` up in its shard, whose lock must be held.
+    bool Lookup( const Shard& shard, string_view name, uint32_t hash, Symbol& symbol ) const;
+    // Adds `name` as the next symbol. Takes `mAppendMutex`.
+    Symbol Append( string_view name );
+    // Puts a new symbol in its shard, whose lock must be held.
+    static void Insert( Shard& shard, Symbol symbol, uint32_t hash );
+
+    static uint32_t Hash( string_view name );
+
+    Shard mShards[ 1 << ShardBits ];
+    // For adding names: the pages, directories, and blocks.
+    std::mutex mAppendMutex;
+    std::atomic< size_t > mSize{ 0 };
+
+    // The page directory readers use. When it fills up, it's copied into one twice as big,
+    // but the old ones are kept (in `mDirectories`) in case someone is still reading them.
+    std::atomic< Page** > mPages{ nullptr };
+    size_t mDirectoryCapacity = 0;
+    vector< std::unique_ptr< Page*[] > > mDirectories;
+    vector< std::unique_ptr< Page > > mPageStorage;
+
+    // The characters of every name.
+    vector< std::unique_ptr< char[] > > mBlocks;
+    char* mCursor = nullptr;
+    size_t mLeft = 0;
+};
+
+}
@@ -1,7 +1,9 @@
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace disco {
 typedef std::string string;
+typedef std::string_view string_view;
 template<typename T> using vector = std::vector<T>;
 }
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "component.h"
+#include "entity.h"
+#include "version.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// A type-erased, contiguous array of one component type.
+// This is one "column" in an archetype's structure-of-arrays layout.
+//
+// If it is given the ECS's version clock, the column also remembers, per chunk of
+// `ChunkSize` rows, the version at which something in that chunk was last written.
+// Appending and swap-removing mark the rows they touch. Everyone else who writes
+// (queries with non-const components, `ECS::Get()`) calls `MarkChanged()`.
+class Column {
+public:
+    explicit Column( const ComponentInfo& info, const VersionClock* clock = nullptr ) : mInfo( &info ), mClock( clock ) {}
+    ~Column() { Clear(); Deallocate(); }
+
+    Column( Column&& other ) noexcept
+        : mInfo( other.mInfo ), mClock( other.mClock ), mVersions( std::move( other.mVersions ) ),
+          mData( other.mData ), mSize( other.mSize ), mCapacity( other.mCapacity ), mOwned( other.mOwned )
+    {
+        other.mData = nullptr;
+        other.mSize = other.mCapacity = 0;
+    }
+    Column& operator=( Column&& other ) noexcept {
+        if( this != &other ) {
+            Clear();
+            Deallocate();
+            mInfo = other.mInfo;
+            mClock = other.mClock;
+            mVersions = std::move( other.mVersions );
+            mData = other.mData;
+            mSize = other.mSize;
+            mCapacity = other.mCapacity;
+            mOwned = other.mOwned;
+            other.mData = nullptr;
+            other.mSize = other.mCapacity = 0;
+        }
+        return *this;
+    }
+    Column( const Column& ) = delete;
+    Column& operator=( const Column& ) = delete;
+
+    const ComponentInfo& Info() const { return *mInfo; }
+    size_t Size() const { return mSize; }
+
+    void* At( size_t row ) { return mData + row*mInfo->size; }
+    const void* At( size_t row ) const { return mData + row*mInfo->size; }
+
+    template< typename T > T* Data() { return reinterpret_cast<T*>( mData ); }
+    template< typename T > const T* Data() const { return reinterpret_cast<const T*>( mData ); }
+
+    void Reserve( size_t capacity ) {
+        if( capacity <= mCapacity ) return;
+
+        std::byte* data = static_cast<std::byte*>( ::operator new( capacity*mInfo->size, std::align_val_t( mInfo->align ) ) );
+        if( mData ) mInfo->relocate( data, mData, mSize );
+        Deallocate();
+        mData = data;
+        mCapacity = capacity;
+        mOwned = true;
+        if( mClock ) mVersions.Reserve( capacity );
+    }
+
+    // Append a default-constructed value.
+    void* EmplaceDefault() {
+        MakeRoom();
+        mInfo->construct( At( mSize ) );
+        MarkChanged( mSize );
+        return At( mSize++ );
+    }
+    // Append a value moved out of `src`, which must point to a value of this column's type.
+    void* EmplaceMoved( void* src ) {
+        MakeRoom();
+        mInfo->move_construct( At( mSize ), src );
+        MarkChanged( mSize );
+        return At( mSize++ );
+    }
+    // Append a value constructed from `args`.
+    template< typename T, typename... Args >
+    T& Emplace( Args&&... args ) {
+        assert( GetComponentID<T>() == mInfo->id );
+        MakeRoom();
+        T* result;
+        // Prefer a constructor, but fall back to braces so aggregates like `Position{ 1, 2 }` work.
+        if constexpr( std::is_constructible_v< T, Args... > ) result = new (At( mSize )) T( std::forward<Args>( args )... );
+        else result = new (At( mSize )) T{ std::forward<Args>( args )... };
+        MarkChanged( mSize );
+        ++mSize;
+        return *result;
+    }
+
+    // Append `count` copies of the value at `src`. The component must be copyable.
+    void AppendCopies( const void* src, size_t count ) {
+        if( count == 0 ) return;
+        assert( mInfo->fill );
+        if( mSize + count > mCapacity ) Reserve( std::max( mSize + count, 2*mCapacity ) );
+        mInfo->fill( At( mSize ), src, count );
+        if( mClock ) mVersions.MarkRows( mSize, mSize + count, mClock->load( std::memory_order_relaxed ) );
+        mSize += count;
+    }
+    // Append `count` values copied byte for byte from `src`.
+    // Only for trivially copyable components.
+    void AppendBytes( const void* src, size_t count ) {
+        if( count == 0 ) return;
+        if( mSize + count > mCapacity ) Reserve( std::max( mSize + count, 2*mCapacity ) );
+        std::memcpy( At( mSize ), src, count*mInfo->size );
+        if( mClock ) mVersions.MarkRows( mSize, mSize + count, mClock->load( std::memory_order_relaxed ) );
+        mSize += count;
+    }
+    // Use the `count` values at `data` in place instead of copying them. The column must be empty,
+    // the component trivially copyable, and `data` suitably aligned. The column doesn't free `data`,
+    // so it has to outlive the column. The first time the column grows, it copies the values
+    // into memory of its own.
+    void Borrow( void* data, size_t count ) {
+        assert( mSize == 0 );
+        Deallocate();
+        mData = static_cast<std::byte*>( data );
+        mSize = mCapacity = count;
+        mOwned = false;
+        if( mClock ) {
+            mVersions.Reserve( count );
+            mVersions.MarkRows( 0, count, mClock->load( std::memory_order_relaxed ) );
+        }
+    }
+
+    // Remove `row` by moving the last value into its place.
+    void SwapRemove( size_t row ) {
+        assert( row < mSize );
+        mInfo->destroy( At( row ) );
+        if( row != mSize-1 ) {
+            mInfo->relocate( At( row ), At( mSize-1 ), 1 );
+            MarkChanged( row );
+        }
+        --mSize;
+    }
+
+    // Change tracking. These do nothing for a column without a clock.
+    bool Tracked() const { return mClock != nullptr; }
+    void MarkChanged( size_t row ) { if( mClock ) mVersions.Mark( row, mClock->load( std::memory_order_relaxed ) ); }
+    void MarkChanged( size_t row, uint64_t version ) { if( mClock ) mVersions.Mark( row, version ); }
+    // Marks every row in [begin, end), for code that writes a whole range through `Data()`.
+    void MarkRows( size_t begin, size_t end ) { if( mClock ) mVersions.MarkRows( begin, end, mClock->load( std::memory_order_relaxed ) ); }
+    // The version at which chunk `chunk` (rows `chunk*ChunkSize` onwards) was last written.
+    // Without a clock, everything always counts as changed.
+    uint64_t ChunkVersion( size_t chunk ) const { return mClock ? mVersions.Get( chunk ) : UINT64_MAX; }
+
+    void Clear() {
+        for( size_t i = 0; i < mSize; ++i ) mInfo->destroy( At( i ) );
+        mSize = 0;
+    }
+
+private:
+    void MakeRoom() {
+        if( mSize == mCapacity ) Reserve( mCapacity == 0 ? 16 : 2*mCapacity );
+    }
+    void Deallocate() {
+        if( mData && mOwned ) ::operator delete( mData, std::align_val_t( mInfo->align ) );
+        mData = nullptr;
+        mCapacity = 0;
+    }
+
+    const ComponentInfo* mInfo;
+    const VersionClock* mClock;
+    ChunkVersions mVersions;
+    std::byte* mData = nullptr;
+    size_t mSize = 0;
+    size_t mCapacity = 0;
+    // False while the values live in someone else's memory (see `Borrow()`).
+    bool mOwned = true;
+};
+
+// An archetype holds every entity that has exactly the same set of components.
+// Each component type gets its own contiguous column, and row `i` of every column
+// (and of `Entities()`) belongs to the same entity. Systems that visit many entities
+// walk these columns front to back, which is what makes an ECS cache friendly.
+class Archetype {
+public:
+    // Used for "no archetype" and "no edge yet".
+    static constexpr uint32_t None = UINT32_MAX;
+
+    // `infos` must be sorted by component ID and contain no duplicates.
+    // The columns track changes against `clock` if one is given.
+    explicit Archetype( const std::vector< const ComponentInfo* >& infos, const VersionClock* clock = nullptr ) {
+        mTypes.reserve( infos.size() );
+        mColumns.reserve( infos.size() );
+        for( const ComponentInfo* info : infos ) {
+            mTypes.push_back( info->id );
+            mColumns.emplace_back( *info, clock );
+
+            if( info->id >= mColumnOf.size() ) mColumnOf.resize( info->id+1, None );
+            mColumnOf[ info->id ] = uint32_t( mColumns.size()-1 );
+        }
+    }
+
+    // The sorted component IDs that make up this archetype.
+    const std::vector< ComponentID >& Types() const { return mTypes; }
+    size_t Size() const { return mEntities.size(); }
+    const std::vector< EntityID >& Entities() const { return mEntities; }
+
+    bool HasComponent( ComponentID id ) const { return ColumnIndex( id ) != None; }
+    // Direct lookup from a component ID to the column holding it. No hashing.
+    uint32_t ColumnIndex( ComponentID id ) const { return id < mColumnOf.size() ? mColumnOf[id] : None; }
+
+    Column& GetColumn( uint32_t index ) { return mColumns[index]; }
+    const Column& GetColumn( uint32_t index ) const { return mColumns[index]; }
+    std::vector< Column >& Columns() { return mColumns; }
+
+    template< typename T > T* ColumnData() {
+        const uint32_t index = ColumnIndex( GetComponentID<T>() );
+        return index == None ? nullptr : mColumns[index].Data<T>();
+    }
+
+    // Append the entity and return its row. The caller is responsible for
+    // appending one value to every column so that they stay the same length.
+    uint32_t PushEntity( EntityID e ) {
+        mEntities.push_back( e );
+        return uint32_t( mEntities.size()-1 );
+    }
+    void PushEntities( const EntityID* entities, size_t count ) { mEntities.insert( mEntities.end(), entities, entities + count ); }
+    // Remove the entity at `row` from every column by swapping in the last row.
+    // Returns the entity that now lives at `row` (or an invalid entity if `row` was the last one).
+    EntityID SwapRemove( uint32_t row ) {
+        for( Column& c : mColumns ) c.SwapRemove( row );
+        mEntities[row] = mEntities.back();
+        mEntities.pop_back();
+        return row < mEntities.size() ? mEntities[row] : EntityID();
+    }
+
+    // The archetype graph. Adding or dropping a component moves an entity
+    // along one of these edges. They are filled in lazily by the ECS.
+    uint32_t AddEdge( ComponentID id ) const { return id < mAddEdges.size() ? mAddEdges[id] : None; }
+    uint32_t RemoveEdge( ComponentID id ) const { return id < mRemoveEdges.size() ? mRemoveEdges[id] : None; }
+    void SetAddEdge( ComponentID id, uint32_t archetype ) { SetEdge( mAddEdges, id, archetype ); }
+    void SetRemoveEdge( ComponentID id, uint32_t archetype ) { SetEdge( mRemoveEdges, id, archetype ); }
+
+private:
+    static void SetEdge( std::vector< uint32_t >& edges, ComponentID id, uint32_t archetype ) {
+        if( id >= edges.size() ) edges.resize( id+1, None );
+        edges[id] = archetype;
+    }
+
+    std::vector< ComponentID > mTypes;
+    std::vector< Column > mColumns;
+    std::vector< EntityID > mEntities;
+    // Indexed by ComponentID.
+    std::vector< uint32_t > mColumnOf;
+    std::vector< uint32_t > mAddEdges;
+    std::vector< uint32_t > mRemoveEdges;
+};
+
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "ecs.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// Finds every pair of overlapping boxes among the entities that have both a `Position`
+// and a `Collider`, without testing every pair (sweep-and-prune).
+//
+// `Position` can be any component with float-like `x` and `y` members, and `Collider`
+// any component with `x` and `y` as full width and height. Boxes are centered on their position.
+// A negative width or height counts as positive. An entity whose box isn't finite (NaN or
+// infinite position or size) is left out until it is.
+//
+// Each box has a left and a right end on the x axis. All the ends are kept in one sorted list.
+// Walking the list left to right, a box is "open" between its two ends, and when a box opens
+// it can only overlap the boxes that are already open. Those get a y test.
+//
+// The list is kept from frame to frame. Things don't move far in one frame, so the list is
+// almost sorted already, and insertion sort puts it back in order in close to linear time.
+//
+//     Broadphase< Position, Collider > broadphase( ecs );
+//     ...
+//     broadphase.Update();
+//     for( const auto& [a, b] : broadphase.Pairs() ) { ... }
+template< typename Position, typename Collider >
+class Broadphase {
+public:
+    typedef std::pair< EntityID, EntityID > Pair;
+
+    explicit Broadphase( ECS& ecs ) : mECS( ecs ) {}
+
+    // Picks up new, moved, and removed colliders, and finds the overlapping pairs.
+    // Call it once per frame, after things have moved.
+    void Update() {
+        ++mFrame;
+        Gather();
+        if( mNumSeen < mBoxes.size() ) Compact();
+
+        // The ends keep their order from last frame but take on this frame's values.
+        const size_t kept_ends = mEnds.size() - 2*mNumAdded;
+        for( End& end : mEnds ) {
+            const Box& box = mBoxes[ end.box ];
+            end.value = end.right ? box.max_x : box.min_x;
+        }
+        InsertionSort( mEnds.begin(), mEnds.begin() + kept_ends );
+        // New boxes can be anywhere, so they are sorted on their own and merged in.
+        if( kept_ends < mEnds.size() ) {
+            std::sort( mEnds.begin() + kept_ends, mEnds.end(), Before );
+            std::inplace_merge( mEnds.begin(), mEnds.begin() + kept_ends, mEnds.end(), Before );
+        }
+
+        Sweep();
+    }
+
+    // The overlapping pairs found by the last `Update()`, each once, in no particular order.
+    // The vector is reused, so copy it if you need it after the next `Update()`.
+    const std::vector< Pair >& Pairs() const { return mPairs; }
+
+    size_t NumEntities() const { return mBoxes.size(); }
+
+private:
+    static constexpr uint32_t None = UINT32_MAX;
+
+    struct Box {
+        EntityID entity;
+        float min_x, max_x, min_y, max_y;
+        // The last `Update()` that saw this entity.
+        uint32_t frame;
+        // Where this box is in the open list during the sweep.
+        uint32_t open_index;
+    };
+    struct End {
+        float value;
+        uint32_t box : 31;
+        uint32_t right : 1;
+    };
+
+    // Left ends go before right ends at the same place, so boxes that just touch count as overlapping.
+    static bool Before( const End& a, const End& b ) { return a.value < b.value || ( a.value == b.value && a.right < b.right ); }
+
+    template< typename It >
+    static void InsertionSort( It begin, It end ) {
+        if( begin == end ) return;
+        for( It i = begin + 1; i < end; ++i ) {
+            if( !Before( *i, *(i-1) ) ) continue;
+            const End moving = *i;
+            It j = i;
+            for( ; j > begin && Before( moving, *(j-1) ); --j ) *j = *(j-1);
+            *j = moving;
+        }
+    }
+
+    uint32_t SlotOf( EntityID e ) const { return e.Index() < mSlots.size() ? mSlots[ e.Index() ] : None; }
+
+    // Refreshes every box from its components and adds boxes for new colliders.
+    void Gather() {
+        mNumSeen = 0;
+        mNumAdded = 0;
+        mECS.ForEach< const Position, const Collider >( [&]( EntityID e, const Position& p, const Collider& c ) {
+            const float half_w = std::abs( float( c.x ) ) / 2, half_h = std::abs( float( c.y ) ) / 2;
+            const float min_x = float( p.x ) - half_w, max_x = float( p.x ) + half_w;
+            const float min_y = float( p.y ) - half_h, max_y = float( p.y ) + half_h;
+            // A NaN would break the sort order. Not seeing the entity drops its box, if it had one.
+            if( !std::isfinite( min_x ) || !std::isfinite( max_x ) || !std::isfinite( min_y ) || !std::isfinite( max_y ) ) return;
+
+            uint32_t slot = SlotOf( e );
+            // A recycled entity index gets a new box. The old one isn't seen this frame, so it's compacted away.
+            if( slot == None || mBoxes[slot].entity != e ) {
+                if( e.Index() >= mSlots.size() ) mSlots.resize( e.Index()+1, None );
+                slot = mSlots[ e.Index() ] = uint32_t( mBoxes.size() );
+                mBoxes.push_back( Box{ e, 0, 0, 0, 0, 0, None } );
+                mEnds.push_back( End{ 0, slot, 0 } );
+                mEnds.push_back( End{ 0, slot, 1 } );
+                ++mNumAdded;
+            }
+            Box& box = mBoxes[slot];
+            box.min_x = min_x;
+            box.max_x = max_x;
+            box.min_y = min_y;
+            box.max_y = max_y;
+            box.frame = mFrame;
+            ++mNumSeen;
+        } );
+    }
+
+    // Drops the boxes of entities that were destroyed or lost a component.
+    // The survivors keep their order, and so do their ends.
+    void Compact() {
+        mRemap.assign( mBoxes.size(), None );
+        uint32_t kept = 0;
+        for( uint32_t slot = 0; slot < mBoxes.size(); ++slot ) {
+            const Box& box = mBoxes[slot];
+            const uint32_t index = box.entity.Index();
+            if( box.frame != mFrame ) {
+                // Unless a recycled entity has already taken over the index.
+                if( mSlots[ index ] == slot ) mSlots[ index ] = None;
+                continue;
+            }
+            mRemap[slot] = kept;
+            mSlots[ index ] = kept;
+            mBoxes[ kept++ ] = box;
+        }
+        mBoxes.resize( kept );
+
+        size_t out = 0;
+        for( const End& end : mEnds ) {
+            if( mRemap[ end.box ] == None ) continue;
+            mEnds[ out ] = end;
+            mEnds[ out++ ].box = mRemap[ end.box ];
+        }
+        mEnds.resize( out );
+    }
+
+    void Sweep() {
+        mPairs.clear();
+        mOpen.clear();
+        for( const End& end : mEnds ) {
+            Box& box = mBoxes[ end.box ];
+            if( end.right ) {
+                // Every box's left end sorts before its right end, so the box is open.
+                assert( !mOpen.empty() && mOpen[ box.open_index ] == end.box );
+                // Swap-and-pop out of the open list.
+                const uint32_t last = mOpen.back();
+                mOpen[ box.open_index ] = last;
+                mBoxes[ last ].open_index = box.open_index;
+                mOpen.pop_back();
+                continue;
+            }
+            // Everything open overlaps on x. Check y.
+            for( uint32_t other : mOpen ) {
+                const Box& o = mBoxes[ other ];
+                if( box.min_y <= o.max_y && o.min_y <= box.max_y ) mPairs.emplace_back( o.entity, box.entity );
+            }
+            box.open_index = uint32_t( mOpen.size() );
+            mOpen.push_back( end.box );
+        }
+    }
+
+    ECS& mECS;
+    uint32_t mFrame = 0;
+
+    std::vector< Box > mBoxes;
+    // Indexed by `EntityID::Index()`.
+    std::vector< uint32_t > mSlots;
+    // Two per box, sorted by `Before()` after each `Update()`.
+    std::vector< End > mEnds;
+    std::vector< Pair > mPairs;
+
+    // Scratch space, kept to avoid allocating every frame.
+    std::vector< uint32_t > mOpen;
+    std::vector< uint32_t > mRemap;
+    size_t mNumSeen = 0;
+    size_t mNumAdded = 0;
+};
+
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "component.h"
+#include "entity.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+class ECS;
+
+// Records structural changes (spawning, destroying, adding and dropping components)
+// so they can be made later, when nothing is iterating.
+//
+// Inside `ForEach()`, and especially inside `ParallelForEach()` or a scheduled system,
+// the ECS can't change shape underneath the loop. Instead, each thread records into its own
+// buffer (`ECS::Commands()`), and `ECS::Playback()` applies every buffer at once:
+//     ecs.ParallelForEach< const Health >( [&]( EntityID e, const Health& h ) {
+//         if( h.hp <= 0 ) ecs.Commands().Destroy( e );
+//     } );
+//     ecs.Playback();
+//
+// Component values are moved into the buffer's own memory when they are recorded.
+class CommandBuffer {
+public:
+    // An entity that `Spawn()` will create at playback. It can be given components
+    // with `Add()` on the same buffer.
+    struct Pending { uint32_t index; };
+
+    enum class Kind : uint8_t { Spawn, Add, Drop, Destroy };
+
+    struct Command {
+        Kind kind;
+        // If true, `target` is a `Pending::index` from this buffer rather than an `EntityID`.
+        bool pending;
+        ComponentID component;
+        EntityID::IDType target;
+        // `Add()` keeps the component value here. `apply` does the work for `Add()` and `Drop()`.
+        void* payload;
+        void (*apply)( ECS&, EntityID, void* );
+        void (*destroy)( void* );
+    };
+
+    CommandBuffer() = default;
+    ~CommandBuffer() { Clear(); }
+    CommandBuffer( const CommandBuffer& ) = delete;
+    CommandBuffer& operator=( const CommandBuffer& ) = delete;
+
+    Pending Spawn() {
+        mCommands.push_back( Command{ Kind::Spawn, false, 0, mNumSpawned, nullptr, nullptr, nullptr } );
+        return Pending{ mNumSpawned++ };
+    }
+
+    void Destroy( EntityID e ) {
+        mCommands.push_back( Command{ Kind::Destroy, false, 0, e.id, nullptr, nullptr, nullptr } );
+    }
+
+    // Records `ecs.Add< T >( e, args... )`. The value is constructed now and moved in at playback.
+    template< typename T, typename... Args >
+    void Add( EntityID e, Args&&... args ) { Record< T >( false, e.id, std::forward<Args>( args )... ); }
+    template< typename T, typename... Args >
+    void Add( Pending e, Args&&... args ) { Record< T >( true, e.index, std::forward<Args>( args )... ); }
+
+    template< typename T >
+    void Drop( EntityID e ) {
+        mCommands.push_back( Command{ Kind::Drop, false, GetComponentID<T>(), e.id, nullptr, &DropFrom< T, ECS >, nullptr } );
+    }
+
+    bool Empty() const { return mCommands.empty(); }
+    size_t Size() const { return mCommands.size(); }
+    size_t NumSpawned() const { return mNumSpawned; }
+    // The commands in the order they were recorded.
+    const std::vector< Command >& Commands() const { return mCommands; }
+
+    // Forgets every command. The memory is kept for the next frame.
+    void Clear() {
+        for( Command& c : mCommands ) if( c.destroy ) c.destroy( c.payload );
+        mCommands.clear();
+        mNumSpawned = 0;
+        mBlock = 0;
+        mUsed = 0;
+    }
+
+private:
+    template< typename T, typename... Args >
+    void Record( bool pending, EntityID::IDType target, Args&&... args ) {
+        void* payload = Allocate( sizeof( T ), alignof( T ) );
+        if constexpr( std::is_constructible_v< T, Args... > ) new (payload) T( std::forward<Args>( args )... );
+        else new (payload) T{ std::forward<Args>( args )... };
+        mCommands.push_back( Command{ Kind::Add, pending, GetComponentID<T>(), target, payload, &AddTo< T, ECS >, &Destroy< T > } );
+    }
+
+    // `World` is always `ECS`. It's a template parameter so that these are only
+    // compiled once `ECS` is a complete type.
+    template< typename T, typename World >
+    static void AddTo( World& world, EntityID e, void* payload ) { world.template Add< T >( e, std::move( *static_cast< T* >( payload ) ) ); }
+    template< typename T, typename World >
+    static void DropFrom( World& world, EntityID e, void* ) { world.template Drop< T >( e ); }
+    template< typename T >
+    static void Destroy( void* payload ) { static_cast< T* >( payload )->~T(); }
+
+    // Payloads go into large blocks that are never moved, so recording is usually
+    // just a bump of `mUsed`. Blocks are reused after `Clear()`.
+    static constexpr size_t BlockSize = 64*1024;
+    struct Block {
+        std::unique_ptr< std::byte[] > bytes;
+        size_t size;
+    };
+    void* Allocate( size_t size, size_t align ) {
+        for( ;; ) {
+            if( mBlock < mBlocks.size() ) {
+                Block& b = mBlocks[ mBlock ];
+                void* p = b.bytes.get() + mUsed;
+                size_t space = b.size - mUsed;
+                if( std::align( align, size, p, space ) ) {
+                    mUsed = b.size - space + size;
+                    return p;
+                }
+                ++mBlock;
+                mUsed = 0;
+                continue;
+            }
+            const size_t bytes = std::max( BlockSize, size + align );
+            mBlocks.push_back( Block{ std::unique_ptr< std::byte[] >( new std::byte[ bytes ] ), bytes } );
+        }
+    }
+
+    std::vector< Command > mCommands;
+    uint32_t mNumSpawned = 0;
+    std::vector< Block > mBlocks;
+    size_t mBlock = 0;
+    size_t mUsed = 0;
+};
+
+}
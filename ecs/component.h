@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// The name of type `T` as the compiler spells it, worked out at compile time.
+// For example, `TypeName< Position >()` is "Position". Different compilers may spell
+// templates and namespaces differently, so don't rely on it being portable.
+template< typename T >
+constexpr std::string_view TypeName() {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+    // "... ecs::TypeName<struct Position>(void)"
+    const std::string_view f = __FUNCSIG__;
+    const size_t begin = f.find( "TypeName<" ) + 9;
+    std::string_view name = f.substr( begin, f.rfind( ">(void)" ) - begin );
+    for( std::string_view keyword : { "struct ", "class ", "enum " } ) {
+        if( name.substr( 0, keyword.size() ) == keyword ) name.remove_prefix( keyword.size() );
+    }
+    return name;
+#else
+    // GCC: "... ecs::TypeName() [with T = Position; std::string_view = ...]"
+    // Clang: "... ecs::TypeName() [T = Position]"
+    const std::string_view f = __PRETTY_FUNCTION__;
+    const size_t begin = f.find( "T = " ) + 4;
+    return f.substr( begin, f.find_first_of( ";]", begin ) - begin );
+#endif
+}
+
+// A 64-bit hash (FNV-1a) of `TypeName< T >()`, also computed at compile time.
+// It's the same from run to run, so it can go in a `switch` or be saved to a file.
+template< typename T >
+constexpr uint64_t TypeHash() {
+    uint64_t hash = 14695981039346656037ull;
+    for( char c : TypeName<T>() ) {
+        hash ^= uint8_t( c );
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Every component type gets a small integer ID the first time it's used.
+// Archetypes store their component set as a sorted list of these IDs,
+// and they use them to index directly into per-archetype lookup tables.
+// IDs are handed out in the order types are first used, so unlike `TypeHash()`,
+// they can differ from run to run. Hot paths look components up by these IDs, never by name.
+typedef uint32_t ComponentID;
+
+namespace detail {
+    // Every ID handed out so far, with the name it was given.
+    struct ComponentRegistry {
+        std::mutex mutex;
+        std::vector< std::string > names;
+    };
+    inline ComponentRegistry& Registry() {
+        static ComponentRegistry registry;
+        return registry;
+    }
+
+    inline ComponentID NextComponentID( std::string_view name ) {
+        ComponentRegistry& registry = Registry();
+        std::lock_guard< std::mutex > lock( registry.mutex );
+        registry.names.emplace_back( name );
+        return ComponentID( registry.names.size()-1 );
+    }
+}
+
+template< typename T >
+ComponentID GetComponentID() {
+    // A function-local static is initialized exactly once (thread-safely),
+    // so every call for the same `T` returns the same ID.
+    static const ComponentID id = detail::NextComponentID( TypeName<T>() );
+    return id;
+}
+
+// The name of the type (or Lua component) that was given `id`, for messages and debugging.
+inline std::string ComponentName( ComponentID id ) {
+    detail::ComponentRegistry& registry = detail::Registry();
+    std::lock_guard< std::mutex > lock( registry.mutex );
+    return id < registry.names.size() ? registry.names[id] : "component " + std::to_string( id );
+}
+
+// Archetype columns are untyped blocks of bytes.
+// `ComponentInfo` remembers how to construct, move, and destroy the values inside them.
+struct ComponentInfo {
+    ComponentID id;
+    size_t size;
+    size_t align;
+
+    // Default-construct a value in uninitialized memory.
+    void (*construct)( void* dst );
+    // Move-construct a value from `src` into uninitialized memory. `src` is left moved-from.
+    void (*move_construct)( void* dst, void* src );
+    // Destroy a value in place.
+    void (*destroy)( void* ptr );
+    // Move `count` values from `src` into uninitialized `dst` and destroy the originals.
+    void (*relocate)( void* dst, void* src, size_t count );
+    // Copy-construct `count` copies of `*src` into uninitialized `dst`.
+    // nullptr if the type can't be copied.
+    void (*fill)( void* dst, const void* src, size_t count );
+};
+
+namespace detail {
+    template< typename T >
+    auto FillFunction() -> void (*)( void*, const void*, size_t ) {
+        if constexpr( !std::is_copy_constructible_v<T> ) {
+            return nullptr;
+        } else if constexpr( std::is_trivially_copyable_v<T> ) {
+            return []( void* dst, const void* src, size_t count ) {
+                if( count == 0 ) return;
+                // Copy one, then keep doubling what's been copied.
+                std::byte* d = static_cast<std::byte*>( dst );
+                std::memcpy( d, src, sizeof(T) );
+                for( size_t done = 1; done < count; ) {
+                    const size_t n = std::min( done, count - done );
+                    std::memcpy( d + done*sizeof(T), d, n*sizeof(T) );
+                    done += n;
+                }
+            };
+        } else {
+            return []( void* dst, const void* src, size_t count ) {
+                T* d = static_cast<T*>( dst );
+                for( size_t i = 0; i < count; ++i ) new (d+i) T( *static_cast<const T*>( src ) );
+            };
+        }
+    }
+}
+
+template< typename T >
+const ComponentInfo& GetComponentInfo() {
+    static_assert( std::is_default_constructible_v<T>, "Components must be default constructible." );
+    static_assert( std::is_move_constructible_v<T>, "Components must be move constructible." );
+
+    static const ComponentInfo info{
+        GetComponentID<T>(),
+        sizeof(T),
+        alignof(T),
+        []( void* dst ) { new (dst) T{}; },
+        []( void* dst, void* src ) { new (dst) T( std::move( *static_cast<T*>( src ) ) ); },
+        []( void* ptr ) { static_cast<T*>( ptr )->~T(); },
+        []( void* dst, void* src, size_t count ) {
+            if constexpr( std::is_trivially_copyable_v<T> ) {
+                // Plain old data can be moved all at once.
+                if( count > 0 ) std::memcpy( dst, src, count*sizeof(T) );
+            } else {
+                T* d = static_cast<T*>( dst );
+                T* s = static_cast<T*>( src );
+                for( size_t i = 0; i < count; ++i ) {
+                    new (d+i) T( std::move( s[i] ) );
+                    s[i].~T();
+                }
+            }
+        },
+        detail::FillFunction<T>()
+    };
+    return info;
+}
+
+}
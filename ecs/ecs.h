@@ -0,0 +1,702 @@
+#pragma once
+
+#include "entity.h"
+#include "component.h"
+#include "archetype.h"
+#include "sparse_set.h"
+#include "query.h"
+#include "command_buffer.h"
+#include "prefab.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+class Snapshot;
+
+namespace detail {
+    // Each ECS gets a unique number, so a thread can tell which one its cached command buffer belongs to.
+    inline uint64_t NextWorldID() {
+        static std::atomic< uint64_t > next{1};
+        return next++;
+    }
+}
+
+// An archetype-based Entity Component System.
+//
+// Entities with the same set of components live together in one `Archetype`,
+// whose components are stored as contiguous columns. Adding or dropping a component
+// moves the entity (and all its other components) to the archetype for its new set.
+//
+// Components that declare `Storage::SparseSet` (see `sparse_set.h`) skip the archetypes
+// and live in a per-type `SparseSet` pool instead. Their `Get()`, `Has()`, and `Drop()`
+// are O(1) array lookups, and adding or dropping them never moves the entity.
+//
+// Every column and pool remembers, per chunk of entities, the `Version()` at which
+// it was last written. That lets a system ask for `Changed< T >` entities only.
+//
+// Watch out: adding, dropping, or destroying can move components in memory, so a
+// reference returned by `Get()` is only good until the next structural change.
+// Inside a loop, record structural changes in `Commands()` and `Playback()` them afterwards.
+class ECS {
+public:
+    ECS() {
+        // Archetype 0 is the empty set. New entities start there.
+        mArchetypes.push_back( std::make_unique< Archetype >( std::vector< const ComponentInfo* >{}, &mVersion ) );
+        mArchetypeLookup[ {} ] = 0;
+    }
+    ECS( const ECS& ) = delete;
+    ECS& operator=( const ECS& ) = delete;
+
+    // Returns an unused entity ID.
+    // Slots of destroyed entities are recycled with a bumped generation.
+    EntityID CreateEntity() {
+        if( mFree.size() <= MinimumFree && mRecords.size() > EntityID::MaxIndex ) throw std::length_error( "ECS: out of entity IDs" );
+        const EntityID e = NewEntity( 0, uint32_t( mArchetypes[0]->Size() ) );
+        mArchetypes[0]->PushEntity( e );
+        return e;
+    }
+
+    // Copies the entity's components into a `Prefab` for `SpawnBatch()`.
+    // Throws `std::logic_error` if one of them can't be copied.
+    Prefab MakePrefab( EntityID e ) const {
+        const Record& r = RecordFor( e );
+        const Archetype& a = *mArchetypes[ r.archetype ];
+        Prefab prefab;
+        prefab.mWorldID = mWorldID;
+        prefab.mArchetype = r.archetype;
+        for( uint32_t c = 0; c < a.Types().size(); ++c ) {
+            const Column& column = a.GetColumn( c );
+            if( !column.Info().fill ) throw std::logic_error( "ECS: prefab components must be copy constructible" );
+            prefab.Add( column.Info(), false, column.At( r.row ) );
+        }
+        for( const auto& pool : mPools ) {
+            const uint32_t index = pool ? pool->IndexOf( e ) : SparseSetBase::None;
+            if( index == SparseSetBase::None ) continue;
+            const ComponentInfo* info = pool->Info();
+            if( !info || !info->fill ) throw std::logic_error( "ECS: prefab components must be copy constructible" );
+            prefab.Add( *info, true, pool->ValueAt( index ) );
+        }
+        return prefab;
+    }
+
+    // Creates `count` entities with copies of the prefab's components and returns them.
+    // This is much faster than creating them one at a time: the entities go straight into
+    // their final archetype, and each column (and sparse pool) grows once and gets all
+    // `count` copies in one go.
+    std::vector< EntityID > SpawnBatch( const Prefab& prefab, size_t count ) {
+        if( prefab.mWorldID != mWorldID ) throw std::logic_error( "ECS: prefab belongs to a different ECS" );
+        const size_t recycled = mFree.size() > MinimumFree ? std::min( count, mFree.size() - MinimumFree ) : 0;
+        if( mRecords.size() + ( count - recycled ) > size_t( EntityID::MaxIndex ) + 1 ) throw std::length_error( "ECS: out of entity IDs" );
+        // Grow geometrically, so spawning small batches in a loop stays amortized O(1) per entity.
+        const size_t records = mRecords.size() + ( count - recycled );
+        if( records > mRecords.capacity() ) mRecords.reserve( std::max( records, 2*mRecords.capacity() ) );
+
+        Archetype& a = *mArchetypes[ prefab.mArchetype ];
+        std::vector< EntityID > entities( count );
+        for( size_t i = 0; i < count; ++i ) entities[i] = NewEntity( prefab.mArchetype, uint32_t( a.Size() + i ) );
+        a.PushEntities( entities.data(), count );
+        for( uint32_t c = 0; c < a.Types().size(); ++c ) {
+            Column& column = a.GetColumn( c );
+            column.AppendCopies( prefab.Find( column.Info().id )->data, count );
+        }
+        for( const Prefab::Value& v : prefab.mValues ) {
+            if( v.sparse ) mPools[ v.info->id ]->EmplaceCopies( entities.data(), count, v.data );
+        }
+        return entities;
+    }
+
+    // Destroys the entity and all of its components.
+    void Destroy( EntityID e ) {
+        Record& r = RecordFor( e );
+        // One O(1) removal per sparse component type.
+        for( auto& pool : mPools ) if( pool ) pool->Remove( e );
+        RemoveRow( r.archetype, r.row );
+        r.archetype = Archetype::None;
+        // Any copies of `e` that are still around are now stale.
+        r.generation = ( r.generation + 1 ) & ( ( 1u << EntityID::GenerationBits ) - 1 );
+        mFree.push_back( e.Index() );
+        --mNumAlive;
+    }
+
+    // False for destroyed entities, including stale IDs whose slot has since been reused.
+    bool Alive( EntityID e ) const {
+        if( !e.Valid() || e.Index() >= mRecords.size() ) return false;
+        const Record& r = mRecords[ e.Index() ];
+        return r.archetype != Archetype::None && r.generation == e.Generation();
+    }
+    size_t NumEntities() const { return mNumAlive; }
+
+    template< typename T >
+    bool Has( EntityID e ) const {
+        const Record& r = RecordFor( e );
+        if constexpr( IsSparse<T> ) {
+            const SparseSet<T>* pool = FindPool<T>();
+            return pool && pool->Has( e );
+        } else {
+            return mArchetypes[ r.archetype ]->HasComponent( GetComponentID<T>() );
+        }
+    }
+
+    // Returns the entity's component, or nullptr if it doesn't have one.
+    // This counts as writing the component for `Changed<>` queries. The const version doesn't.
+    template< typename T >
+    T* TryGet( EntityID e ) {
+        const Record& r = RecordFor( e );
+        if constexpr( IsSparse<T> ) {
+            SparseSet<T>* pool = FindPool<T>();
+            return pool ? pool->TryGet( e ) : nullptr;
+        } else {
+            Archetype& a = *mArchetypes[ r.archetype ];
+            const uint32_t column = a.ColumnIndex( GetComponentID<T>() );
+            if( column == Archetype::None ) return nullptr;
+            a.GetColumn( column ).MarkChanged( r.row );
+            return a.GetColumn( column ).Data<T>() + r.row;
+        }
+    }
+    template< typename T >
+    const T* TryGet( EntityID e ) const {
+        const Record& r = RecordFor( e );
+        if constexpr( IsSparse<T> ) {
+            const SparseSet<T>* pool = FindPool<T>();
+            return pool ? pool->TryGet( e ) : nullptr;
+        } else {
+            const Archetype& a = *mArchetypes[ r.archetype ];
+            const uint32_t column = a.ColumnIndex( GetComponentID<T>() );
+            if( column == Archetype::None ) return nullptr;
+            return a.GetColumn( column ).Data<T>() + r.row;
+        }
+    }
+
+    // Returns the entity's component, creating a default one first if it doesn't have one.
+    template< typename T >
+    T& Get( EntityID e ) {
+        if( T* existing = TryGet<T>( e ) ) return *existing;
+        return Add<T>( e );
+    }
+
+    // Gives the entity a component constructed from `args`, replacing any it already had.
+    template< typename T, typename... Args >
+    T& Add( EntityID e, Args&&... args ) {
+        if( T* existing = TryGet<T>( e ) ) {
+            // Same construction as `Column::Emplace()`, so both paths build the same value.
+            if constexpr( std::is_constructible_v< T, Args... > ) *existing = T( std::forward<Args>( args )... );
+            else *existing = T{ std::forward<Args>( args )... };
+            return *existing;
+        }
+        if constexpr( IsSparse<T> ) {
+            return Pool<T>().Emplace( e, std::forward<Args>( args )... );
+        } else {
+            const ComponentInfo& info = GetComponentInfo<T>();
+            const uint32_t dst = AddTarget( RecordFor( e ).archetype, info );
+            MoveEntity( e, dst );
+            Archetype& a = *mArchetypes[ dst ];
+            return a.GetColumn( a.ColumnIndex( info.id ) ).template Emplace<T>( std::forward<Args>( args )... );
+        }
+    }
+
+    // Removes the component from the entity. Does nothing if it doesn't have one.
+    template< typename T >
+    void Drop( EntityID e ) {
+        const Record& r = RecordFor( e );
+        if constexpr( IsSparse<T> ) {
+            if( SparseSet<T>* pool = FindPool<T>() ) pool->Remove( e );
+        } else {
+            const ComponentID id = GetComponentID<T>();
+            if( !mArchetypes[ r.archetype ]->HasComponent( id ) ) return;
+
+            MoveEntity( e, RemoveTarget( r.archetype, id ) );
+        }
+    }
+
+    // Calls `fn` for every entity that has all of the given components
+    // and none of the components listed in a `Without< ... >`:
+    //     ecs.ForEach< Position, const Velocity, Without< Frozen > >( [&]( Position& p, const Velocity& v ) { ... } );
+    // `fn` may also take the entity first: `[&]( EntityID e, Position& p, const Velocity& v ) { ... }`.
+    //
+    // Archetypes that match are visited one at a time, straight down their columns.
+    // If the query includes a sparse component whose pool is smaller than all the
+    // matching archetypes put together, that pool drives the loop instead, and the
+    // other components are found by direct index from each entity.
+    //
+    // Don't create or destroy entities or add or drop components inside `fn`.
+    // Record them in `Commands()` instead.
+    template< typename... Ts, typename F >
+    void ForEach( F&& fn ) {
+        using Query = detail::QueryTraits< Ts... >;
+        static_assert( std::is_same_v< typename Query::Changed, detail::TypeList<> >, "Changed<> needs a last_run: ForEach< ... >( last_run, fn )" );
+        ForEachImpl( fn, 0, typename Query::Include{}, typename Query::Exclude{}, typename Query::Changed{} );
+    }
+
+    // Like `ForEach()`, for a system that keeps `last_run` (starting at 0) from one call to the next.
+    // `Changed< T >` filters then skip entities whose `T` hasn't been written since the previous call:
+    //     uint64_t mLastRun = 0;
+    //     ecs.ForEach< const Position, InstanceData, Changed< Position > >( mLastRun, [&]( const Position& p, InstanceData& d ) { ... } );
+    // Writes made by `fn` itself don't count as changes the next time around.
+    template< typename... Ts, typename F >
+    void ForEach( uint64_t& last_run, F&& fn ) {
+        using Query = detail::QueryTraits< Ts... >;
+        const uint64_t since = last_run;
+        last_run = mVersion.load();
+        ForEachImpl( fn, since, typename Query::Include{}, typename Query::Exclude{}, typename Query::Changed{} );
+        // Anything written from now on is newer than `last_run`.
+        ++mVersion;
+    }
+
+    // Like `ForEach()`, but spread across `Threads()`.
+    // The matching entities are cut into ranges of `grain` entities, in the same order
+    // `ForEach()` would visit them, and the ranges are handed to the thread pool.
+    // This returns once every range is done. Every entity is visited exactly once, so as
+    // long as `fn` only writes to the components it is given, the result is exactly what
+    // `ForEach()` would produce, no matter how many threads there are or who ran what.
+    //
+    // `fn` runs on several threads at once. It must not touch shared state without
+    // synchronization, and it must not make structural changes (except through `Commands()`).
+    //
+    // `grain` is rounded up to whole chunks, so no two ranges share a chunk of an archetype.
+    template< typename... Ts, typename F >
+    void ParallelForEach( F&& fn, size_t grain = 4096 ) {
+        using Query = detail::QueryTraits< Ts... >;
+        static_assert( std::is_same_v< typename Query::Changed, detail::TypeList<> >, "Changed<> needs a last_run: ParallelForEach< ... >( last_run, fn )" );
+        ParallelForEachImpl( fn, grain, 0, typename Query::Include{}, typename Query::Exclude{}, typename Query::Changed{} );
+    }
+    // `ParallelForEach()` with a `last_run`, like the second `ForEach()`.
+    template< typename... Ts, typename F >
+    void ParallelForEach( uint64_t& last_run, F&& fn, size_t grain = 4096 ) {
+        using Query = detail::QueryTraits< Ts... >;
+        const uint64_t since = last_run;
+        last_run = mVersion.load();
+        ParallelForEachImpl( fn, grain, since, typename Query::Include{}, typename Query::Exclude{}, typename Query::Changed{} );
+        ++mVersion;
+    }
+
+    // The calling thread's command buffer. Record structural changes here while
+    // systems are running, then apply them all with `Playback()`.
+    CommandBuffer& Commands() {
+        // Finding the buffer takes a lock, so each thread remembers the last one it used.
+        thread_local struct { uint64_t world = 0; CommandBuffer* buffer = nullptr; } cached;
+        if( cached.world == mWorldID ) return *cached.buffer;
+
+        std::lock_guard< std::mutex > lock( mCommandsMutex );
+        const std::thread::id self = std::this_thread::get_id();
+        auto found = std::find_if( mCommandBuffers.begin(), mCommandBuffers.end(), [&]( const auto& b ) { return b.first == self; } );
+        if( found == mCommandBuffers.end() ) {
+            mCommandBuffers.emplace_back( self, std::make_unique< CommandBuffer >() );
+            found = mCommandBuffers.end()-1;
+        }
+        cached.world = mWorldID;
+        cached.buffer = found->second.get();
+        return *cached.buffer;
+    }
+
+    // Applies every thread's recorded commands, then clears the buffers.
+    // Call this at a sync point, when no `ForEach()` or system is running.
+    //
+    // All spawns happen first, then all adds and drops, then all destroys. Adds and drops
+    // are sorted by component type and then by entity, so that consecutive commands
+    // touch the same pool or archetype. Commands for the same entity and component keep
+    // their recorded order. Commands for an entity that is gone by then are skipped.
+    void Playback() {
+        std::lock_guard< std::mutex > lock( mCommandsMutex );
+
+        // Spawns, in the order they were recorded.
+        std::vector< std::vector< EntityID > > spawned( mCommandBuffers.size() );
+        for( size_t b = 0; b < mCommandBuffers.size(); ++b ) {
+            spawned[b].reserve( mCommandBuffers[b].second->NumSpawned() );
+            for( const CommandBuffer::Command& c : mCommandBuffers[b].second->Commands() ) {
+                if( c.kind == CommandBuffer::Kind::Spawn ) spawned[b].push_back( CreateEntity() );
+            }
+        }
+
+        struct Ref {
+            ComponentID component;
+            EntityID entity;
+            uint32_t buffer;
+            uint32_t sequence;
+            const CommandBuffer::Command* command;
+        };
+        std::vector< Ref > changes, destroys;
+        for( size_t b = 0; b < mCommandBuffers.size(); ++b ) {
+            const std::vector< CommandBuffer::Command >& commands = mCommandBuffers[b].second->Commands();
+            for( size_t i = 0; i < commands.size(); ++i ) {
+                const CommandBuffer::Command& c = commands[i];
+                if( c.kind == CommandBuffer::Kind::Spawn ) continue;
+                const EntityID e = c.pending ? spawned[b][ c.target ] : EntityID( c.target );
+                ( c.kind == CommandBuffer::Kind::Destroy ? destroys : changes ).push_back( Ref{ c.component, e, uint32_t(b), uint32_t(i), &c } );
+            }
+        }
+        auto order = []( const Ref& a, const Ref& b ) {
+            return std::make_tuple( a.component, a.entity.Index(), a.buffer, a.sequence ) < std::make_tuple( b.component, b.entity.Index(), b.buffer, b.sequence );
+        };
+        std::sort( changes.begin(), changes.end(), order );
+        std::sort( destroys.begin(), destroys.end(), order );
+
+        for( const Ref& r : changes ) if( Alive( r.entity ) ) r.command->apply( *this, r.entity, r.command->payload );
+        for( const Ref& r : destroys ) if( Alive( r.entity ) ) Destroy( r.entity );
+
+        for( auto& b : mCommandBuffers ) b.second->Clear();
+    }
+
+    // The current version. Writes are stamped with it, and each `ForEach()` with a
+    // `last_run` moves it forward.
+    uint64_t Version() const { return mVersion.load(); }
+
+    // The thread pool used by `ParallelForEach()`. It starts one thread per core
+    // the first time it is needed, unless you call `SetThreads()` first.
+    ThreadPool& Threads() {
+        if( !mThreads ) mThreads = std::make_unique< ThreadPool >();
+        return *mThreads;
+    }
+    void SetThreads( size_t count ) { mThreads = std::make_unique< ThreadPool >( count ); }
+
+    // Systems can also iterate archetypes directly.
+    size_t NumArchetypes() const { return mArchetypes.size(); }
+    Archetype& GetArchetype( size_t index ) { return *mArchetypes[ index ]; }
+    const Archetype& GetArchetype( size_t index ) const { return *mArchetypes[ index ]; }
+
+    // The pool holding a sparse component type, created on first use.
+    template< typename T >
+    SparseSet<T>& Pool() {
+        static_assert( IsSparse<T>, "Only components with Storage::SparseSet have a pool." );
+        const ComponentID id = GetComponentID<T>();
+        if( id >= mPools.size() ) mPools.resize( id+1 );
+        if( !mPools[id] ) mPools[id] = std::make_unique< SparseSet<T> >( &mVersion );
+        return static_cast< SparseSet<T>& >( *mPools[id] );
+    }
+    // The pool holding a sparse component type, or nullptr if none has been created yet.
+    template< typename T >
+    SparseSet<T>* FindPool() {
+        const ComponentID id = GetComponentID<T>();
+        return id < mPools.size() ? static_cast< SparseSet<T>* >( mPools[id].get() ) : nullptr;
+    }
+    template< typename T >
+    const SparseSet<T>* FindPool() const {
+        const ComponentID id = GetComponentID<T>();
+        return id < mPools.size() ? static_cast< const SparseSet<T>* >( mPools[id].get() ) : nullptr;
+    }
+
+private:
+    // What a query will visit, worked out once per call.
+    struct QueryPlan {
+        // A required sparse component has no pool, so nothing can match.
+        bool empty = false;
+        // If set, this pool drives the loop. Otherwise, the matching archetypes do.
+        const SparseSetBase* driver = nullptr;
+        // Indexed by archetype: does it have all the required table components and none of the excluded ones?
+        std::vector< char > matches;
+    };
+
+    template< typename... Cs, typename... Xs, typename... Gs >
+    QueryPlan PlanQuery( detail::TypeList< Cs... >, detail::TypeList< Xs... >, detail::TypeList< Gs... > ) const {
+        static_assert( sizeof...( Cs ) > 0, "ForEach needs at least one component." );
+        QueryPlan plan;
+
+        // The smallest required sparse pool is a candidate to drive the loop.
+        auto consider = [&]( const SparseSetBase* pool ) {
+            if( !pool ) plan.empty = true;
+            else if( !plan.driver || pool->Size() < plan.driver->Size() ) plan.driver = pool;
+        };
+        ( [&] { if constexpr( IsSparse< std::remove_const_t<Cs> > ) consider( FindPool< std::remove_const_t<Cs> >() ); }(), ... );
+        // A component that must have changed must also be there.
+        ( [&] { if constexpr( IsSparse<Gs> ) consider( FindPool<Gs>() ); }(), ... );
+        if( plan.empty ) return plan;
+
+        plan.matches.resize( mArchetypes.size() );
+        size_t rows = 0;
+        for( size_t i = 0; i < mArchetypes.size(); ++i ) {
+            const Archetype& a = *mArchetypes[i];
+            plan.matches[i] = ( Requires< Cs >( a ) && ... ) && ( Requires< Gs >( a ) && ... ) && !( Excludes< Xs >( a ) || ... );
+            if( plan.matches[i] ) rows += a.Size();
+        }
+        // Only drive from a pool if that means visiting fewer entities.
+        if( plan.driver && plan.driver->Size() >= rows ) plan.driver = nullptr;
+        return plan;
+    }
+
+    // Visits rows [begin, end) of archetype `a`, which must match the query.
+    template< typename... Cs, typename... Xs, typename... Gs, typename F >
+    void VisitRows( F& fn, Archetype& a, uint32_t begin, uint32_t end, [[maybe_unused]] uint64_t since, detail::TypeList< Cs... >, detail::TypeList< Xs... >, detail::TypeList< Gs... > ) {
+        std::tuple< detail::Fetch< Cs >... > fetch{ MakeFetch< Cs >()... };
+        std::tuple< detail::Since< Gs >... > changed{ MakeSince< Gs >( since )... };
+        std::apply( [&]( auto&... f ) { ( f.Bind( a ), ... ); }, fetch );
+        std::apply( [&]( auto&... c ) { ( c.Bind( a ), ... ); }, changed );
+        const std::vector< EntityID >& entities = a.Entities();
+        uint64_t rows = 0, chunks = 0;
+        for( uint32_t chunk_begin = begin; chunk_begin < end; ) {
+            const size_t chunk = chunk_begin / ChunkSize;
+            const uint32_t chunk_end = uint32_t( std::min< size_t >( end, ( chunk+1 )*ChunkSize ) );
+            // Skip the whole chunk if a `Changed<>` table component wasn't written in it.
+            if( std::apply( [&]( auto&... c ) { return ( c.ChunkChanged( chunk ) && ... ); }, changed ) ) {
+                for( uint32_t row = chunk_begin; row < chunk_end; ++row ) Visit< Xs... >( fn, fetch, changed, entities[row], row );
+                rows += chunk_end - chunk_begin;
+                ++chunks;
+            }
+            chunk_begin = chunk_end;
+        }
+        detail::CountQuery( rows, chunks );
+    }
+
+    // Visits entries [begin, end) of the plan's driver pool.
+    template< typename... Cs, typename... Xs, typename... Gs, typename F >
+    void VisitDriven( F& fn, const QueryPlan& plan, size_t begin, size_t end, [[maybe_unused]] uint64_t since, detail::TypeList< Cs... >, detail::TypeList< Xs... >, detail::TypeList< Gs... > ) {
+        std::tuple< detail::Fetch< Cs >... > fetch{ MakeFetch< Cs >()... };
+        std::tuple< detail::Since< Gs >... > changed{ MakeSince< Gs >( since )... };
+        const std::vector< EntityID >& entities = plan.driver->Entities();
+        uint32_t bound = Archetype::None;
+        for( size_t i = begin; i < end; ++i ) {
+            const EntityID e = entities[i];
+            const Record& r = mRecords[ e.Index() ];
+            if( !plan.matches[ r.archetype ] ) continue;
+            if( r.archetype != bound ) {
+                std::apply( [&]( auto&... f ) { ( f.Bind( *mArchetypes[ r.archetype ] ), ... ); }, fetch );
+                std::apply( [&]( auto&... c ) { ( c.Bind( *mArchetypes[ r.archetype ] ), ... ); }, changed );
+                bound = r.archetype;
+            }
+            Visit< Xs... >( fn, fetch, changed, e, r.row );
+        }
+        detail::CountQuery( end - begin, ( end - begin + ChunkSize - 1 ) / ChunkSize );
+    }
+
+    template< typename... Xs, typename F, typename Fetches, typename Changes >
+    void Visit( F& fn, Fetches& fetch, const Changes& changed, EntityID e, uint32_t row ) {
+        const bool match = std::apply( [&]( auto&... f ) { return ( f.Match( e, row ) && ... ); }, fetch );
+        if( !match || ( SparseExcludes< Xs >( e ) || ... ) ) return;
+        if( !std::apply( [&]( const auto&... c ) { return ( c.Changed( e, row ) && ... ); }, changed ) ) return;
+        std::apply( [&]( auto&... f ) {
+            if constexpr( std::is_invocable_v< F&, EntityID, decltype( f.Get( row ) )... > ) fn( e, f.Get( row )... );
+            else fn( f.Get( row )... );
+        }, fetch );
+    }
+
+    template< typename Include, typename Exclude, typename Changes, typename F >
+    void ForEachImpl( F& fn, uint64_t since, Include include, Exclude exclude, Changes changed ) {
+        const QueryPlan plan = PlanQuery( include, exclude, changed );
+        if( plan.empty ) return;
+
+        if( plan.driver ) {
+            VisitDriven( fn, plan, 0, plan.driver->Size(), since, include, exclude, changed );
+            return;
+        }
+        for( size_t i = 0; i < mArchetypes.size(); ++i ) {
+            if( plan.matches[i] ) VisitRows( fn, *mArchetypes[i], 0, uint32_t( mArchetypes[i]->Size() ), since, include, exclude, changed );
+        }
+    }
+
+    template< typename Include, typename Exclude, typename Changes, typename F >
+    void ParallelForEachImpl( F& fn, size_t grain, uint64_t since, Include include, Exclude exclude, Changes changed ) {
+        const QueryPlan plan = PlanQuery( include, exclude, changed );
+        if( plan.empty ) return;
+        grain = ( std::max< size_t >( grain, 1 ) + ChunkSize - 1 ) / ChunkSize * ChunkSize;
+
+        // Cut the work into ranges in the same order `ForEach()` would visit them.
+        // The cuts only depend on `grain`, not on the number of threads.
+        struct Range {
+            uint32_t archetype;
+            size_t begin, end;
+        };
+        std::vector< Range > ranges;
+        if( plan.driver ) {
+            for( size_t b = 0; b < plan.driver->Size(); b += grain ) ranges.push_back( Range{ Archetype::None, b, std::min( b+grain, plan.driver->Size() ) } );
+        } else {
+            for( size_t i = 0; i < mArchetypes.size(); ++i ) {
+                if( !plan.matches[i] ) continue;
+                const size_t size = mArchetypes[i]->Size();
+                for( size_t b = 0; b < size; b += grain ) ranges.push_back( Range{ uint32_t(i), b, std::min( b+grain, size ) } );
+            }
+        }
+
+        // Whatever the calling thread is counting into, the helpers count into as well.
+        detail::QueryStats* stats = detail::CurrentQueryStats();
+        Threads().ParallelFor( ranges.size(), [&]( size_t index ) {
+            detail::QueryStatsScope scope( stats );
+            const Range& r = ranges[index];
+            if( r.archetype == Archetype::None ) VisitDriven( fn, plan, r.begin, r.end, since, include, exclude, changed );
+            else VisitRows( fn, *mArchetypes[ r.archetype ], uint32_t( r.begin ), uint32_t( r.end ), since, include, exclude, changed );
+        } );
+    }
+
+    template< typename C >
+    detail::Fetch< C > MakeFetch() {
+        detail::Fetch< C > f;
+        if constexpr( IsSparse< std::remove_const_t<C> > ) f.pool = FindPool< std::remove_const_t<C> >();
+        f.version = mVersion.load( std::memory_order_relaxed );
+        return f;
+    }
+    template< typename G >
+    detail::Since< G > MakeSince( uint64_t since ) {
+        detail::Since< G > c;
+        if constexpr( IsSparse<G> ) c.pool = FindPool<G>();
+        c.since = since;
+        return c;
+    }
+    // Does archetype `a` pass the table part of a query?
+    template< typename C >
+    static bool Requires( const Archetype& a ) {
+        if constexpr( IsSparse< std::remove_const_t<C> > ) return true;
+        else return a.HasComponent( GetComponentID< std::remove_const_t<C> >() );
+    }
+    template< typename X >
+    static bool Excludes( const Archetype& a ) {
+        if constexpr( IsSparse<X> ) return false;
+        else return a.HasComponent( GetComponentID<X>() );
+    }
+    // Excluded sparse components have to be checked entity by entity.
+    template< typename X >
+    bool SparseExcludes( EntityID e ) const {
+        if constexpr( IsSparse<X> ) {
+            const SparseSet<X>* pool = FindPool<X>();
+            return pool && pool->Has( e );
+        } else {
+            return false;
+        }
+    }
+
+    // Where an entity's components live.
+    struct Record {
+        uint32_t archetype = Archetype::None;
+        uint32_t row = 0;
+        // Must match an EntityID's generation for the ID to be alive.
+        uint32_t generation = 0;
+    };
+
+    // Destroyed slots wait in a first-in first-out queue, and aren't reused until
+    // there are at least this many of them. With only 8 bits of generation, that
+    // spreads reuse across many slots so a given slot's generation wraps around slowly.
+    static constexpr size_t MinimumFree = 1024;
+
+    // Hands out an ID and points its record at `row` of `archetype`. The caller puts it there.
+    EntityID NewEntity( uint32_t archetype, uint32_t row ) {
+        EntityID::IDType index;
+        if( mFree.size() > MinimumFree ) {
+            index = mFree.front();
+            mFree.pop_front();
+        } else {
+            index = EntityID::IDType( mRecords.size() );
+            mRecords.emplace_back();
+        }
+
+        Record& r = mRecords[ index ];
+        r.archetype = archetype;
+        r.row = row;
+        ++mNumAlive;
+        return EntityID::Make( index, r.generation );
+    }
+
+    Record& RecordFor( EntityID e ) {
+        if( !Alive( e ) ) throw std::out_of_range( "ECS: entity does not exist or is stale" );
+        return mRecords[ e.Index() ];
+    }
+    const Record& RecordFor( EntityID e ) const {
+        if( !Alive( e ) ) throw std::out_of_range( "ECS: entity does not exist or is stale" );
+        return mRecords[ e.Index() ];
+    }
+
+    // Moves the entity into archetype `dst`, carrying over every component the two archetypes share.
+    // Components `dst` has that the old archetype doesn't are *not* created; the caller must append them.
+    void MoveEntity( EntityID e, uint32_t dst ) {
+        Record& r = RecordFor( e );
+        Archetype& from = *mArchetypes[ r.archetype ];
+        Archetype& to = *mArchetypes[ dst ];
+
+        for( Column& c : from.Columns() ) {
+            const uint32_t column = to.ColumnIndex( c.Info().id );
+            if( column != Archetype::None ) to.GetColumn( column ).EmplaceMoved( c.At( r.row ) );
+        }
+        const uint32_t row = to.PushEntity( e );
+
+        // The moved-from values are destroyed here.
+        RemoveRow( r.archetype, r.row );
+        r.archetype = dst;
+        r.row = row;
+    }
+
+    void RemoveRow( uint32_t archetype, uint32_t row ) {
+        const EntityID moved = mArchetypes[ archetype ]->SwapRemove( row );
+        if( moved.Valid() ) mRecords[ moved.Index() ].row = row;
+    }
+
+    uint32_t AddTarget( uint32_t src, const ComponentInfo& info ) {
+        uint32_t dst = mArchetypes[ src ]->AddEdge( info.id );
+        if( dst != Archetype::None ) return dst;
+
+        std::vector< const ComponentInfo* > infos = InfosOf( *mArchetypes[ src ] );
+        infos.insert( std::upper_bound( infos.begin(), infos.end(), &info, ByID ), &info );
+        dst = FindOrCreateArchetype( infos );
+
+        mArchetypes[ src ]->SetAddEdge( info.id, dst );
+        mArchetypes[ dst ]->SetRemoveEdge( info.id, src );
+        return dst;
+    }
+
+    uint32_t RemoveTarget( uint32_t src, ComponentID id ) {
+        uint32_t dst = mArchetypes[ src ]->RemoveEdge( id );
+        if( dst != Archetype::None ) return dst;
+
+        std::vector< const ComponentInfo* > infos = InfosOf( *mArchetypes[ src ] );
+        infos.erase( std::find_if( infos.begin(), infos.end(), [&]( const ComponentInfo* i ) { return i->id == id; } ) );
+        dst = FindOrCreateArchetype( infos );
+
+        mArchetypes[ src ]->SetRemoveEdge( id, dst );
+        mArchetypes[ dst ]->SetAddEdge( id, src );
+        return dst;
+    }
+
+    uint32_t FindOrCreateArchetype( const std::vector< const ComponentInfo* >& infos ) {
+        std::vector< ComponentID > types;
+        types.reserve( infos.size() );
+        for( const ComponentInfo* info : infos ) types.push_back( info->id );
+
+        // This lookup only happens the first time an edge is followed.
+        auto found = mArchetypeLookup.find( types );
+        if( found != mArchetypeLookup.end() ) return found->second;
+
+        mArchetypes.push_back( std::make_unique< Archetype >( infos, &mVersion ) );
+        const uint32_t index = uint32_t( mArchetypes.size()-1 );
+        mArchetypeLookup[ types ] = index;
+        return index;
+    }
+
+    static std::vector< const ComponentInfo* > InfosOf( Archetype& a ) {
+        std::vector< const ComponentInfo* > infos;
+        infos.reserve( a.Columns().size() );
+        for( const Column& c : a.Columns() ) infos.push_back( &c.Info() );
+        return infos;
+    }
+    static bool ByID( const ComponentInfo* a, const ComponentInfo* b ) { return a->id < b->id; }
+
+    // Saving and loading needs to see everything.
+    friend class Snapshot;
+    // Files loaded by `Snapshot` in place. Declared before the archetypes so that it outlives their columns.
+    std::vector< std::shared_ptr< const void > > mSnapshotMemory;
+    // Archetypes are held by pointer so that references to them survive `mArchetypes` growing.
+    std::vector< std::unique_ptr< Archetype > > mArchetypes;
+    std::map< std::vector< ComponentID >, uint32_t > mArchetypeLookup;
+    // Indexed by `EntityID::Index()`.
+    std::vector< Record > mRecords;
+    std::deque< EntityID::IDType > mFree;
+    size_t mNumAlive = 0;
+    // Sparse component pools, indexed by ComponentID. Table components have a nullptr here.
+    std::vector< std::unique_ptr< SparseSetBase > > mPools;
+    std::unique_ptr< ThreadPool > mThreads;
+    const uint64_t mWorldID = detail::NextWorldID();
+    std::mutex mCommandsMutex;
+    std::vector< std::pair< std::thread::id, std::unique_ptr< CommandBuffer > > > mCommandBuffers;
+    // Starts at 1 so that everything counts as changed for a system that has never run (last_run = 0).
+    VersionClock mVersion{ 1 };
+};
+
+}
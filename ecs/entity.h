@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint> // For uint32_t
+
+namespace ecs {
+
+// If you want to use the `EntityID` struct directly as the key for a data structure
+// like an `std::unordered_map` or `std::unordered_set`, use its `.id`.
+// Otherwise, you will have to write additional code to tell the data structure
+// how to hash and compare `EntityID`s. See `docs/entity_struct_in_an_unordered_map.txt`
+// for details.
+
+// An EntityID struct that stores the actual ID and supports `.Get<Component>()`
+//
+// The id is a 32-bit integer made of two parts (see `docs/64 or 32-bit entity IDs.txt`):
+// the low 24 bits are an index (a slot in the ECS's tables) and the high 8 bits are a
+// generation. When an entity is destroyed, its slot is eventually reused for a new entity
+// with the next generation. Old copies of the destroyed entity's ID keep the old generation,
+// so the ECS can tell that they are stale instead of silently returning the new entity's data.
+struct EntityID {
+    // The id is a 32-bit integer.
+    typedef uint32_t IDType;
+    static constexpr int IndexBits = 24;
+    static constexpr int GenerationBits = 8;
+    static constexpr IDType IndexMask = ( IDType(1) << IndexBits ) - 1;
+    // All bits set means "no entity". That index is never handed out.
+    static constexpr IDType Invalid = ~IDType(0);
+    static constexpr IDType MaxIndex = IndexMask - 1;
+
+    // Instance variable holding the actual ID, initialized to "no entity".
+    IDType id{Invalid};
+    // Construct this object with the actual ID.
+    EntityID( IDType val ) : id(val) {}
+    // We still want the default constructor.
+    EntityID() = default;
+
+    // Pack an index and a generation.
+    static EntityID Make( IDType index, IDType generation ) {
+        return EntityID( ( generation << IndexBits ) | ( index & IndexMask ) );
+    }
+    IDType Index() const { return id & IndexMask; }
+    IDType Generation() const { return id >> IndexBits; }
+    bool Valid() const { return id != Invalid; }
+
+    // This EntityID can convert itself to an integer on demand.
+    operator IDType() const { return id; }
+
+    // This EntityID supports `.Get<Component>()`
+    // There is no definition in this header, since it needs a global ECS to call.
+    // A program that wants this convenience declares its own global `ECS` and defines
+    // `EntityID::Get()` to call it. See `demo/entity_get.cpp`.
+    template <typename T>
+    T& Get();
+};
+
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "ecs.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#define ECS_SIMD_X86 1
+#include <immintrin.h>
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only let a function use AVX2 instructions if it asks for them.
+// MSVC lets any function use them.
+#if defined( ECS_SIMD_X86 ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define ECS_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#else
+#define ECS_TARGET_AVX2
+#endif
+
+namespace ecs {
+
+// A built-in physics system: moves every entity with a `Position` and a `Velocity`
+// by one time step, with optional gravity and drag.
+//
+//     Motion motion;
+//     motion.dt = 1.f/60;
+//     motion.gravity_y = -9.8f;
+//     Integrate< Position, Velocity >( ecs, motion );
+//
+// It does the same thing as
+//
+//     ecs.ForEach< Position, Velocity >( [&]( Position& p, Velocity& v ) {
+//         v.x = v.x * keep + gravity_x * dt;   v.y = v.y * keep + gravity_y * dt;
+//         p.x += v.x * dt;                     p.y += v.y * dt;
+//     } );
+//
+// but without a call per entity. `Position` and `Velocity` must both be exactly two floats,
+// `x` then `y`, so a column of either one is just a long array of floats: x, y, x, y, ...
+// Those arrays are walked 8 floats at a time with AVX2 or 4 at a time with SSE,
+// whichever the CPU has (see `BestSimd()`), and the archetypes are cut into ranges
+// for `ECS::Threads()`.
+
+struct Motion {
+    // The time step.
+    float dt = 0;
+    // Added to every velocity, per unit of time.
+    float gravity_x = 0, gravity_y = 0;
+    // The fraction of velocity lost per unit of time. 0 is no drag.
+    float drag = 0;
+};
+
+enum class Simd { Scalar, SSE, AVX2 };
+
+inline const char* SimdName( Simd simd ) {
+    switch( simd ) {
+        case Simd::SSE: return "SSE";
+        case Simd::AVX2: return "AVX2";
+        default: return "scalar";
+    }
+}
+
+// The widest instruction set this CPU (and operating system) supports. Checked once.
+inline Simd BestSimd() {
+    static const Simd best = []() {
+#if defined( ECS_SIMD_X86 ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx2" ) ? Simd::AVX2 : Simd::SSE;
+#elif defined( ECS_SIMD_X86 ) && defined( _MSC_VER )
+        int info[4];
+        __cpuid( info, 0 );
+        if( info[0] < 7 ) return Simd::SSE;
+        __cpuid( info, 1 );
+        // The OS has to save the AVX registers on a context switch.
+        const bool os_saves_avx = ( info[2] & ( 1 << 27 ) ) && ( _xgetbv( 0 ) & 6 ) == 6;
+        __cpuidex( info, 7, 0 );
+        return os_saves_avx && ( info[1] & ( 1 << 5 ) ) ? Simd::AVX2 : Simd::SSE;
+#else
+        return Simd::Scalar;
+#endif
+    }();
+    return best;
+}
+
+namespace detail {
+    // Every kernel integrates `count` floats, alternating x and y.
+    // `gravity_dt` is gravity times dt, for x and y. `keep` is what's left of velocity after drag.
+    struct Step {
+        float dt;
+        float keep;
+        float gravity_dt[2];
+    };
+
+    // `count` is always even, so every pair starts with an x.
+    inline void IntegrateScalar( float* position, float* velocity, size_t count, const Step& s ) {
+        for( size_t i = 0; i < count; i += 2 ) {
+            velocity[i] = velocity[i] * s.keep + s.gravity_dt[0];
+            velocity[i+1] = velocity[i+1] * s.keep + s.gravity_dt[1];
+            position[i] = position[i] + velocity[i] * s.dt;
+            position[i+1] = position[i+1] + velocity[i+1] * s.dt;
+        }
+    }
+
+#if defined( ECS_SIMD_X86 )
+    // Groups of 4 also start with an x.
+    inline void IntegrateSSE( float* position, float* velocity, size_t count, const Step& s ) {
+        const __m128 dt = _mm_set1_ps( s.dt );
+        const __m128 keep = _mm_set1_ps( s.keep );
+        const __m128 gravity = _mm_setr_ps( s.gravity_dt[0], s.gravity_dt[1], s.gravity_dt[0], s.gravity_dt[1] );
+        size_t i = 0;
+        for( ; i + 4 <= count; i += 4 ) {
+            const __m128 v = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( velocity + i ), keep ), gravity );
+            _mm_storeu_ps( velocity + i, v );
+            _mm_storeu_ps( position + i, _mm_add_ps( _mm_loadu_ps( position + i ), _mm_mul_ps( v, dt ) ) );
+        }
+        IntegrateScalar( position + i, velocity + i, count - i, s );
+    }
+
+    ECS_TARGET_AVX2 inline void IntegrateAVX2( float* position, float* velocity, size_t count, const Step& s ) {
+        const __m256 dt = _mm256_set1_ps( s.dt );
+        const __m256 keep = _mm256_set1_ps( s.keep );
+        const __m256 gravity = _mm256_setr_ps( s.gravity_dt[0], s.gravity_dt[1], s.gravity_dt[0], s.gravity_dt[1],
+                                               s.gravity_dt[0], s.gravity_dt[1], s.gravity_dt[0], s.gravity_dt[1] );
+        size_t i = 0;
+        for( ; i + 8 <= count; i += 8 ) {
+            const __m256 v = _mm256_add_ps( _mm256_mul_ps( _mm256_loadu_ps( velocity + i ), keep ), gravity );
+            _mm256_storeu_ps( velocity + i, v );
+            _mm256_storeu_ps( position + i, _mm256_add_ps( _mm256_loadu_ps( position + i ), _mm256_mul_ps( v, dt ) ) );
+        }
+        // Don't mix AVX and SSE code without clearing the upper halves of the registers first.
+        _mm256_zeroupper();
+        IntegrateScalar( position + i, velocity + i, count - i, s );
+    }
+#endif
+}
+
+// Integrates `count` entities' worth of packed positions and velocities (`2*count` floats each).
+// Asking for an instruction set the CPU doesn't have is undefined behavior, so stick to `BestSimd()` or lower.
+inline void IntegrateArrays( float* positions, float* velocities, size_t count, const Motion& motion, Simd simd = BestSimd() ) {
+    const detail::Step step{ motion.dt, std::max( 1 - motion.drag * motion.dt, 0.f ), { motion.gravity_x * motion.dt, motion.gravity_y * motion.dt } };
+#if defined( ECS_SIMD_X86 )
+    if( simd == Simd::AVX2 ) return detail::IntegrateAVX2( positions, velocities, 2*count, step );
+    if( simd == Simd::SSE ) return detail::IntegrateSSE( positions, velocities, 2*count, step );
+#endif
+    detail::IntegrateScalar( positions, velocities, 2*count, step );
+}
+
+// Is `T` laid out as two floats named `x` and `y`?
+template< typename T >
+constexpr bool IsPackedFloat2() {
+    if constexpr( std::is_standard_layout_v<T> && std::is_trivially_copyable_v<T> ) {
+        return sizeof(T) == 2*sizeof(float) && alignof(T) == alignof(float) &&
+            std::is_same_v< decltype( T::x ), float > && std::is_same_v< decltype( T::y ), float > &&
+            offsetof( T, x ) == 0 && offsetof( T, y ) == sizeof(float);
+    } else {
+        return false;
+    }
+}
+
+// The system. Runs on `ecs.Threads()` in ranges of `grain` entities (rounded up to whole chunks).
+// Both components count as written for `Changed<>`. In a `Scheduler`, declare it as
+// `Writes< Position, Velocity >()`.
+template< typename Position, typename Velocity >
+void Integrate( ECS& ecs, const Motion& motion, Simd simd = BestSimd(), size_t grain = 16*ChunkSize ) {
+    static_assert( !IsSparse<Position> && !IsSparse<Velocity>, "Integrate() needs Position and Velocity in archetype columns." );
+    static_assert( IsPackedFloat2<Position>() && IsPackedFloat2<Velocity>(), "Integrate() needs Position and Velocity to be exactly { float x, y; }." );
+
+    grain = ( std::max< size_t >( grain, 1 ) + ChunkSize - 1 ) / ChunkSize * ChunkSize;
+    const ComponentID position_id = GetComponentID<Position>();
+    const ComponentID velocity_id = GetComponentID<Velocity>();
+
+    struct Range {
+        Archetype* archetype;
+        size_t begin, end;
+    };
+    std::vector< Range > ranges;
+    for( size_t i = 0; i < ecs.NumArchetypes(); ++i ) {
+        Archetype& a = ecs.GetArchetype( i );
+        if( a.Size() == 0 || !a.HasComponent( position_id ) || !a.HasComponent( velocity_id ) ) continue;
+        for( size_t b = 0; b < a.Size(); b += grain ) ranges.push_back( Range{ &a, b, std::min( b+grain, a.Size() ) } );
+    }
+
+    detail::QueryStats* stats = detail::CurrentQueryStats();
+    ecs.Threads().ParallelFor( ranges.size(), [&]( size_t index ) {
+        detail::QueryStatsScope scope( stats );
+        const Range& r = ranges[index];
+        Column& positions = r.archetype->GetColumn( r.archetype->ColumnIndex( position_id ) );
+        Column& velocities = r.archetype->GetColumn( r.archetype->ColumnIndex( velocity_id ) );
+        IntegrateArrays( reinterpret_cast< float* >( positions.Data<Position>() + r.begin ),
+                         reinterpret_cast< float* >( velocities.Data<Velocity>() + r.begin ),
+                         r.end - r.begin, motion, simd );
+        positions.MarkRows( r.begin, r.end );
+        velocities.MarkRows( r.begin, r.end );
+        detail::CountQuery( r.end - r.begin, ( r.end - r.begin + ChunkSize - 1 ) / ChunkSize );
+    } );
+}
+
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "ecs.h"
+
+#ifndef SOL_ALL_SAFETIES_ON
+#define SOL_ALL_SAFETIES_ON 1
+#endif
+#include <sol/sol.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ecs {
+
+// One component "table" as seen from Lua: `ECS.Components.position`.
+// Lua indexes it with an entity (`ECS.Components.position[e]`) through the
+// `__index` and `__newindex` metamethods, so scripts keep the syntax of the
+// table-of-tables ECS sketch, but the data lives in C++ pools.
+class LuaComponentPool {
+public:
+    virtual ~LuaComponentPool() = default;
+
+    // `pool[e]`: the component, or nil.
+    virtual sol::object Index( EntityID::IDType e, sol::this_state L ) = 0;
+    // `pool[e] = value`. Assigning nil drops the component.
+    virtual void NewIndex( EntityID::IDType e, sol::object value, sol::this_state L ) = 0;
+
+    virtual bool Has( EntityID e ) const = 0;
+    // Lets go of anything the pool keeps for `e`, which is about to be destroyed.
+    // C++ components go with the entity, so only Lua-only pools have anything to do.
+    virtual void Forget( EntityID ) {}
+    // Lets go of anything kept for entities that C++ code destroyed directly.
+    virtual void Prune() {}
+    // May count entities that have been destroyed since the last `Prune()`.
+    virtual size_t Size() const = 0;
+    // A copy of the (live) entities that have this component.
+    virtual std::vector< EntityID > Entities() const = 0;
+};
+
+// A pool for a C++ component type `T` that has been registered with `sol` as a usertype.
+// The components are ordinary ECS components, so C++ systems see the same data.
+// Lua gets a reference to the component, so `ECS.Components.position[e].x = 12`
+// writes straight into the ECS. (Like any `ECS::Get()` reference, it is only good
+// until the next structural change.)
+template< typename T >
+class LuaTypedPool : public LuaComponentPool {
+public:
+    explicit LuaTypedPool( ECS& ecs ) : mECS( ecs ) {}
+
+    sol::object Index( EntityID::IDType id, sol::this_state L ) override {
+        const EntityID e( id );
+        T* component = mECS.Alive( e ) ? mECS.TryGet<T>( e ) : nullptr;
+        if( !component ) return sol::lua_nil;
+        return sol::make_object( L, std::ref( *component ) );
+    }
+
+    void NewIndex( EntityID::IDType id, sol::object value, sol::this_state L ) override {
+        const EntityID e( id );
+        if( value.get_type() == sol::type::lua_nil ) {
+            mECS.Drop<T>( e );
+        } else if( value.is<T>() ) {
+            // Copy first. `value` may refer to a component that moves when `e` changes archetype.
+            T copy = value.as< const T& >();
+            mECS.Add<T>( e, std::move( copy ) );
+        } else if( value.get_type() == sol::type::table ) {
+            // `pool[e] = { x = 10, y = 20 }` starts from a default `T` and assigns each field
+            // through the usertype, just as `pool[e].x = 10` would.
+            T& component = mECS.Add<T>( e );
+            sol::userdata fields = sol::make_object( L, std::ref( component ) ).as< sol::userdata >();
+            for( const auto& kv : value.as< sol::table >() ) fields[ kv.first ] = kv.second;
+        } else {
+            throw sol::error( "ECS: can't assign that value to a C++ component" );
+        }
+    }
+
+    bool Has( EntityID e ) const override { return mECS.Alive( e ) && mECS.Has<T>( e ); }
+
+    size_t Size() const override {
+        if constexpr( IsSparse<T> ) {
+            const SparseSet<T>* pool = mECS.FindPool<T>();
+            return pool ? pool->Size() : 0;
+        } else {
+            size_t size = 0;
+            for( size_t i = 0; i < mECS.NumArchetypes(); ++i ) {
+                const Archetype& a = mECS.GetArchetype( i );
+                if( a.HasComponent( GetComponentID<T>() ) ) size += a.Size();
+            }
+            return size;
+        }
+    }
+
+    std::vector< EntityID > Entities() const override {
+        std::vector< EntityID > result;
+        result.reserve( Size() );
+        // Only reading, so this doesn't make `Changed< T >` fire.
+        mECS.ForEach< const T >( [&]( EntityID e, const T& ) { result.push_back( e ); } );
+        return result;
+    }
+
+private:
+    ECS& mECS;
+};
+
+// A pool for components that only Lua knows about (any Lua value).
+// The values are kept packed in a `SparseSet` rather than a Lua table per component type.
+// The ECS doesn't know about this pool, so entities destroyed from C++ leave their values
+// behind. They are never handed out, and `Prune()` (or reusing the entity's index) lets go of them.
+class LuaObjectPool : public LuaComponentPool {
+public:
+    explicit LuaObjectPool( const ECS& ecs ) : mECS( ecs ) {}
+
+    sol::object Index( EntityID::IDType id, sol::this_state ) override {
+        const EntityID e( id );
+        const sol::object* value = mECS.Alive( e ) ? mPool.TryGet( e ) : nullptr;
+        return value ? *value : sol::object( sol::lua_nil );
+    }
+
+    void NewIndex( EntityID::IDType id, sol::object value, sol::this_state ) override {
+        const EntityID e( id );
+        if( value.get_type() == sol::type::lua_nil ) {
+            mPool.Remove( e );
+        } else if( !mECS.Alive( e ) ) {
+            throw sol::error( "ECS: entity does not exist or is stale" );
+        } else if( sol::object* existing = mPool.TryGet( e ) ) {
+            *existing = std::move( value );
+        } else {
+            // A destroyed entity with the same index may have left its value behind.
+            const EntityID old = mPool.Occupant( e );
+            if( old.Valid() ) mPool.Remove( old );
+            mPool.Emplace( e, std::move( value ) );
+        }
+    }
+
+    bool Has( EntityID e ) const override { return mECS.Alive( e ) && mPool.Has( e ); }
+    void Forget( EntityID e ) override { mPool.Remove( e ); }
+    void Prune() override {
+        // Removing swaps the last entry in, so go backwards.
+        const std::vector< EntityID >& entities = mPool.Entities();
+        for( size_t i = entities.size(); i-- > 0; ) {
+            if( !mECS.Alive( entities[i] ) ) mPool.Remove( entities[i] );
+        }
+    }
+    size_t Size() const override { return mPool.Size(); }
+    std::vector< EntityID > Entities() const override {
+        std::vector< EntityID > result;
+        result.reserve( mPool.Size() );
+        for( EntityID e : mPool.Entities() ) if( mECS.Alive( e ) ) result.push_back( e );
+        return result;
+    }
+
+private:
+    const ECS& mECS;
+    SparseSet< sol::object > mPool;
+};
+
+// Exposes an `ECS` to Lua as the global table `ECS`, with the same interface
+// as the Lua ECS sketch in the README:
+//     local e = ECS.CreateEntity()
+//     ECS.Components.position[e] = { x = 10, y = 20 }
+//     ECS.Components.position[e].x = 12
+//     ECS.Components.position[e] = nil
+//     ECS.ForEach( { "position", "velocity" }, function( e ) ... end )
+//     ECS.DestroyEntity( e )
+// Entities are passed to Lua as their integer `EntityID::id`.
+//
+// Component names registered with `RegisterComponent< T >( name )` map to C++ components.
+// Any other name gets a pool of Lua values the first time it's used.
+//
+// Every name maps to a `ComponentID`, which is the C++ type's own ID for registered
+// components. Looking a pool up by name hashes the string; looking it up by ID is an
+// array index. Scripts with hot loops can look the IDs up once and use them instead:
+//     local position = ECS.ComponentID( "position" )
+//     ECS.ForEach( { position, velocity }, function( e ) local p = ECS.Components[position][e] ... end )
+//
+// Destroy this before the `sol::state`, since the pools hold references into it.
+class LuaECS {
+public:
+    LuaECS( sol::state& lua, ECS& ecs ) : mECS( ecs ) {
+        lua.new_usertype< LuaComponentPool >( "ECSComponentPool",
+            sol::no_constructor,
+            sol::meta_function::index, &LuaComponentPool::Index,
+            sol::meta_function::new_index, &LuaComponentPool::NewIndex,
+            sol::meta_function::length, []( LuaComponentPool& pool ) { pool.Prune(); return pool.Size(); }
+            );
+        // `ECS.Components.name` looks the pool up by name, and `ECS.Components[id]` by ID.
+        lua.new_usertype< LuaECS >( "ECSComponents",
+            sol::no_constructor,
+            sol::meta_function::index, []( LuaECS& self, sol::object key ) { return &self.PoolFor( key ); }
+            );
+
+        sol::table table = lua.create_named_table( "ECS" );
+        table["Components"] = this;
+        table.set_function( "CreateEntity", [this]() { return mECS.CreateEntity().id; } );
+        table.set_function( "DestroyEntity", [this]( EntityID::IDType e ) { DestroyEntity( EntityID( e ) ); } );
+        table.set_function( "GetComponents", [this]( sol::object key ) { return &PoolFor( key ); } );
+        table.set_function( "ComponentID", [this]( const std::string& name ) { return ID( name ); } );
+        table.set_function( "ForEach", [this]( sol::table names, sol::protected_function callback ) { ForEach( names, callback ); } );
+    }
+    ~LuaECS() {
+        // Release the Lua references held by the pools while the state is still alive.
+        mPools.clear();
+    }
+    LuaECS( const LuaECS& ) = delete;
+    LuaECS& operator=( const LuaECS& ) = delete;
+
+    // Makes `ECS.Components[ name ]` refer to C++ components of type `T`.
+    // `T` must already be registered with `sol` via `new_usertype< T >()`.
+    template< typename T >
+    void RegisterComponent( const std::string& name ) {
+        const ComponentID id = GetComponentID<T>();
+        mIDs[ name ] = id;
+        SlotFor( id ) = std::make_unique< LuaTypedPool< T > >( mECS );
+    }
+
+    // The ID for a component name. A name seen for the first time gets a new pool of Lua values.
+    ComponentID ID( const std::string& name ) {
+        auto found = mIDs.find( name );
+        if( found != mIDs.end() ) return found->second;
+        // Lua-only components draw from the same IDs as C++ types, so the two never collide.
+        const ComponentID id = detail::NextComponentID( name );
+        mIDs.emplace( name, id );
+        SlotFor( id ) = std::make_unique< LuaObjectPool >( mECS );
+        return id;
+    }
+
+    // The pool for an ID from `ID()`. No hashing.
+    LuaComponentPool& Pool( ComponentID id ) {
+        if( id >= mPools.size() || !mPools[id] ) throw sol::error( "ECS: unknown component ID " + std::to_string( id ) );
+        return *mPools[id];
+    }
+    LuaComponentPool& PoolFor( const std::string& name ) { return Pool( ID( name ) ); }
+    // A name or an ID, from Lua.
+    LuaComponentPool& PoolFor( const sol::object& key ) {
+        if( key.get_type() == sol::type::number ) return Pool( key.as< ComponentID >() );
+        return PoolFor( key.as< std::string >() );
+    }
+
+    // Does nothing for an entity that is already gone.
+    void DestroyEntity( EntityID e ) {
+        if( !mECS.Alive( e ) ) return;
+        // Lua-only components aren't part of the ECS, so let go of them here.
+        // `Destroy()` drops all the C++ components at once.
+        for( auto& pool : mPools ) if( pool ) pool->Forget( e );
+        mECS.Destroy( e );
+    }
+
+    // Calls `callback( e )` for every entity that has all the named components.
+    // The components can be given by name or by ID.
+    // The loop is driven by the smallest pool, and the candidates are copied first,
+    // so the callback may create and destroy entities and components.
+    void ForEach( sol::table names, sol::protected_function callback ) {
+        std::vector< LuaComponentPool* > pools;
+        for( size_t i = 1; i <= names.size(); ++i ) pools.push_back( &PoolFor( names.get< sol::object >( i ) ) );
+        if( pools.empty() ) return;
+
+        LuaComponentPool* driver = *std::min_element( pools.begin(), pools.end(),
+            []( LuaComponentPool* a, LuaComponentPool* b ) { return a->Size() < b->Size(); } );
+        // Going through the driver anyway, so drop whatever it still keeps for destroyed entities.
+        driver->Prune();
+
+        for( EntityID e : driver->Entities() ) {
+            bool all = true;
+            for( LuaComponentPool* pool : pools ) all = all && pool->Has( e );
+            if( !all ) continue;
+
+            sol::protected_function_result result = callback( e.id );
+            if( !result.valid() ) {
+                sol::error error = result;
+                throw error;
+            }
+        }
+    }
+
+private:
+    std::unique_ptr< LuaComponentPool >& SlotFor( ComponentID id ) {
+        if( id >= mPools.size() ) mPools.resize( id+1 );
+        return mPools[id];
+    }
+
+    ECS& mECS;
+    // Names are only hashed to find the ID.
+    std::unordered_map< std::string, ComponentID > mIDs;
+    // Indexed by ComponentID. Types that Lua doesn't know about have a nullptr here.
+    std::vector< std::unique_ptr< LuaComponentPool > > mPools;
+};
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "component.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// A copy of one entity's components, to stamp out many more like it with `ECS::SpawnBatch()`.
+//
+//     EntityID enemy = ecs.CreateEntity();
+//     ecs.Add<Position>( enemy );
+//     ecs.Add<Health>( enemy, 100 );
+//     const Prefab prefab = ecs.MakePrefab( enemy );
+//     ecs.Destroy( enemy );
+//     ...
+//     std::vector< EntityID > wave = ecs.SpawnBatch( prefab, 5000 );
+//
+// The prefab remembers which archetype its components make up, so spawning doesn't have to
+// walk the archetype graph. It only works with the ECS that made it.
+// Changing the prefab's values (`TryGet()`) changes what later spawns start with.
+class Prefab {
+public:
+    Prefab() = default;
+    ~Prefab() { Clear(); }
+    Prefab( Prefab&& other ) noexcept { *this = std::move( other ); }
+    Prefab& operator=( Prefab&& other ) noexcept {
+        if( this != &other ) {
+            Clear();
+            mWorldID = other.mWorldID;
+            mArchetype = other.mArchetype;
+            mValues = std::move( other.mValues );
+            other.mValues.clear();
+        }
+        return *this;
+    }
+    Prefab( const Prefab& ) = delete;
+    Prefab& operator=( const Prefab& ) = delete;
+
+    size_t NumComponents() const { return mValues.size(); }
+
+    // The prefab's copy of component `T`, or nullptr if it doesn't have one.
+    template< typename T >
+    T* TryGet() {
+        for( Value& v : mValues ) if( v.info->id == GetComponentID<T>() ) return static_cast< T* >( v.data );
+        return nullptr;
+    }
+
+private:
+    friend class ECS;
+
+    struct Value {
+        const ComponentInfo* info;
+        bool sparse;
+        void* data;
+    };
+
+    // Copies the value at `src` into memory of the prefab's own.
+    void Add( const ComponentInfo& info, bool sparse, const void* src ) {
+        void* data = ::operator new( info.size, std::align_val_t( info.align ) );
+        info.fill( data, src, 1 );
+        mValues.push_back( Value{ &info, sparse, data } );
+    }
+    const Value* Find( ComponentID id ) const {
+        for( const Value& v : mValues ) if( v.info->id == id ) return &v;
+        return nullptr;
+    }
+
+    void Clear() {
+        for( Value& v : mValues ) {
+            v.info->destroy( v.data );
+            ::operator delete( v.data, std::align_val_t( v.info->align ) );
+        }
+        mValues.clear();
+    }
+
+    uint64_t mWorldID = 0;
+    uint32_t mArchetype = 0;
+    std::vector< Value > mValues;
+};
+
+}
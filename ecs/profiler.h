@@ -0,0 +1,261 @@
+#pragma once
+
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ecs {
+
+// One system's run in one frame.
+struct SystemSample {
+    uint64_t frame = 0;
+    uint32_t system = 0;
+    // Wall time.
+    uint64_t nanoseconds = 0;
+    // Entities that queries looked at, and the chunks they were in. Chunks skipped
+    // by `Changed<>` don't count. For a loop driven by a sparse pool, these count pool entries.
+    uint64_t entities = 0;
+    uint64_t chunks = 0;
+    // Heap allocations, by any thread working for the system.
+    // Zero unless the program defines `ECS_PROFILER_COUNT_ALLOCATIONS` (see below).
+    uint64_t allocations = 0;
+};
+
+// Records how long each system takes, and how much it does, every frame.
+//
+// Give a `Scheduler` a profiler and it measures every system it runs (plus playing back
+// commands, as "[playback]"). Systems run outside a scheduler can be measured with a `Scope`:
+//     Profiler profiler;
+//     scheduler.SetProfiler( &profiler );
+//     profiler.DumpEvery( 600, "profile.csv", Profiler::Format::CSV );
+//     while( running ) scheduler.Run( ecs ); // Calls `profiler.EndFrame()`.
+//
+// Samples go into a fixed-size ring buffer, so only the most recent `Capacity()` are kept.
+// Recording is lock free: systems running on several threads at once each claim a slot
+// with one atomic increment. `Samples()` can be called at any time; it skips any slot
+// that is being written while it reads.
+//
+// To count allocations, define `ECS_PROFILER_COUNT_ALLOCATIONS` in exactly one .cpp file
+// before including this header. That file then replaces the global `operator new` and
+// `operator delete` with versions that count.
+class Profiler {
+public:
+    typedef std::chrono::steady_clock Clock;
+    enum class Format { CSV, JSON };
+
+    // `capacity` is rounded up to a power of two.
+    explicit Profiler( size_t capacity = 4096 ) {
+        size_t rounded = 1;
+        while( rounded < capacity ) rounded *= 2;
+        mSlots = std::make_unique< Slot[] >( rounded );
+        mMask = rounded - 1;
+    }
+
+    // Gives a system a number for `SystemSample::system`. Call this before anything is recorded.
+    // A name that was added before gets its old number back, so measuring the same thing
+    // again (say, after handing the profiler to a scheduler a second time) doesn't add a row.
+    uint32_t AddSystem( std::string name ) {
+        auto found = std::find( mNames.begin(), mNames.end(), name );
+        if( found != mNames.end() ) return uint32_t( found - mNames.begin() );
+        mNames.push_back( std::move( name ) );
+        return uint32_t( mNames.size()-1 );
+    }
+    const std::string& Name( uint32_t system ) const { return mNames.at( system ); }
+    size_t NumSystems() const { return mNames.size(); }
+    size_t Capacity() const { return mMask + 1; }
+
+    // Measures one run of a system, from construction to destruction.
+    class Scope {
+    public:
+        Scope( Profiler& profiler, uint32_t system )
+            : mProfiler( profiler ), mSystem( system ), mFrame( profiler.Frame() ), mCounting( &mStats ), mStart( Clock::now() ) {}
+        ~Scope() {
+            const Clock::time_point end = Clock::now();
+            mCounting.Close();
+            SystemSample sample;
+            sample.frame = mFrame;
+            sample.system = mSystem;
+            sample.nanoseconds = uint64_t( std::chrono::duration_cast< std::chrono::nanoseconds >( end - mStart ).count() );
+            sample.entities = mStats.entities.load( std::memory_order_relaxed );
+            sample.chunks = mStats.chunks.load( std::memory_order_relaxed );
+            sample.allocations = mStats.allocations.load( std::memory_order_relaxed );
+            mProfiler.Record( sample );
+        }
+        Scope( const Scope& ) = delete;
+        Scope& operator=( const Scope& ) = delete;
+
+    private:
+        Profiler& mProfiler;
+        uint32_t mSystem;
+        uint64_t mFrame;
+        detail::QueryStats mStats;
+        detail::QueryStatsScope mCounting;
+        Clock::time_point mStart;
+    };
+
+    void Record( const SystemSample& sample ) {
+        const uint64_t n = mHead.fetch_add( 1, std::memory_order_relaxed );
+        Slot& slot = mSlots[ n & mMask ];
+        // Odd while writing. Readers that see an odd or unexpected sequence skip the slot.
+        slot.sequence.store( 2*n + 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+        const uint64_t values[ NumValues ] = { sample.frame, sample.system, sample.nanoseconds, sample.entities, sample.chunks, sample.allocations };
+        for( size_t i = 0; i < NumValues; ++i ) slot.values[i].store( values[i], std::memory_order_relaxed );
+        slot.sequence.store( 2*n + 2, std::memory_order_release );
+    }
+
+    // The samples still in the ring, oldest first.
+    std::vector< SystemSample > Samples() const {
+        const uint64_t head = mHead.load( std::memory_order_acquire );
+        const uint64_t first = head > Capacity() ? head - Capacity() : 0;
+        std::vector< SystemSample > samples;
+        samples.reserve( head - first );
+        for( uint64_t n = first; n < head; ++n ) {
+            const Slot& slot = mSlots[ n & mMask ];
+            const uint64_t before = slot.sequence.load( std::memory_order_acquire );
+            if( before != 2*n + 2 ) continue;
+            uint64_t values[ NumValues ];
+            for( size_t i = 0; i < NumValues; ++i ) values[i] = slot.values[i].load( std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_acquire );
+            if( slot.sequence.load( std::memory_order_relaxed ) != before ) continue;
+            samples.push_back( SystemSample{ values[0], uint32_t( values[1] ), values[2], values[3], values[4], values[5] } );
+        }
+        return samples;
+    }
+
+    // The frame that samples are being recorded for.
+    uint64_t Frame() const { return mFrame.load( std::memory_order_relaxed ); }
+
+    // Call once at the end of every frame. Writes the periodic dump, if it's time.
+    void EndFrame() {
+        const uint64_t frame = mFrame.fetch_add( 1, std::memory_order_relaxed ) + 1;
+        if( mDumpEvery > 0 && frame % mDumpEvery == 0 ) Dump( mDumpPath, mDumpFormat );
+    }
+
+    // Every `frames` frames, overwrite `path` with everything in the ring. 0 turns it off.
+    void DumpEvery( uint64_t frames, std::string path, Format format ) {
+        mDumpEvery = frames;
+        mDumpPath = std::move( path );
+        mDumpFormat = format;
+    }
+
+    // Throws `std::runtime_error` if the file can't be written.
+    void Dump( const std::string& path, Format format ) const {
+        std::ofstream out( path, std::ios::trunc );
+        if( !out ) throw std::runtime_error( "Profiler: can't write " + path );
+        if( format == Format::CSV ) WriteCSV( out );
+        else WriteJSON( out );
+        if( !out ) throw std::runtime_error( "Profiler: can't write " + path );
+    }
+
+    void WriteCSV( std::ostream& out ) const {
+        out << "frame,system,nanoseconds,entities,chunks,allocations\n";
+        for( const SystemSample& s : Samples() ) {
+            out << s.frame << ',' << Quoted( s.system, '"', "\"\"" ) << ',' << s.nanoseconds << ','
+                << s.entities << ',' << s.chunks << ',' << s.allocations << '\n';
+        }
+    }
+
+    void WriteJSON( std::ostream& out ) const {
+        const std::vector< SystemSample > samples = Samples();
+        out << "[\n";
+        for( size_t i = 0; i < samples.size(); ++i ) {
+            const SystemSample& s = samples[i];
+            out << "  { \"frame\": " << s.frame << ", \"system\": " << Quoted( s.system, '"', "\\\"" )
+                << ", \"nanoseconds\": " << s.nanoseconds << ", \"entities\": " << s.entities
+                << ", \"chunks\": " << s.chunks << ", \"allocations\": " << s.allocations
+                << ( i+1 < samples.size() ? " },\n" : " }\n" );
+        }
+        out << "]\n";
+    }
+
+private:
+    static constexpr size_t NumValues = 6;
+    struct Slot {
+        std::atomic< uint64_t > sequence{ 0 };
+        std::atomic< uint64_t > values[ NumValues ] = {};
+    };
+
+    // The system's name in double quotes, with `quote` replaced by `escaped`.
+    // Names are meant to be plain identifiers, so other special characters are replaced by '?'.
+    std::string Quoted( uint32_t system, char quote, const char* escaped ) const {
+        std::string result( 1, '"' );
+        for( char c : system < mNames.size() ? mNames[ system ] : std::to_string( system ) ) {
+            if( c == quote ) result += escaped;
+            else if( c == '\\' || uint8_t( c ) < 0x20 ) result += '?';
+            else result += c;
+        }
+        return result + '"';
+    }
+
+    std::unique_ptr< Slot[] > mSlots;
+    size_t mMask;
+    std::atomic< uint64_t > mHead{ 0 };
+    std::atomic< uint64_t > mFrame{ 0 };
+    std::vector< std::string > mNames;
+
+    uint64_t mDumpEvery = 0;
+    std::string mDumpPath;
+    Format mDumpFormat = Format::CSV;
+};
+
+}
+
+#ifdef ECS_PROFILER_COUNT_ALLOCATIONS
+// Replacements for the global allocation functions that count allocations per thread.
+// The standard library routes the array and nothrow forms of `new` and `delete` through these.
+#include <cstdlib>
+#include <new>
+#if defined( _WIN32 )
+#include <malloc.h>
+#endif
+
+// GCC inlines these, sees `new` paired with `free()`, and warns.
+#if defined( __GNUC__ ) && !defined( __clang__ )
+#define ECS_NOINLINE __attribute__(( noinline ))
+#else
+#define ECS_NOINLINE
+#endif
+
+void* operator new( std::size_t size ) {
+    ecs::detail::AllocationCount& counted = ecs::detail::ThreadAllocations();
+    ++counted.count;
+    counted.bytes += size;
+    if( void* p = std::malloc( size ? size : 1 ) ) return p;
+    throw std::bad_alloc();
+}
+ECS_NOINLINE void operator delete( void* p ) noexcept { std::free( p ); }
+void operator delete( void* p, std::size_t ) noexcept { operator delete( p ); }
+
+void* operator new( std::size_t size, std::align_val_t align ) {
+    ecs::detail::AllocationCount& counted = ecs::detail::ThreadAllocations();
+    ++counted.count;
+    counted.bytes += size;
+    const std::size_t alignment = std::max( std::size_t( align ), sizeof( void* ) );
+#if defined( _WIN32 )
+    if( void* p = _aligned_malloc( size ? size : 1, alignment ) ) return p;
+#else
+    void* p = nullptr;
+    if( posix_memalign( &p, alignment, size ? size : 1 ) == 0 ) return p;
+#endif
+    throw std::bad_alloc();
+}
+ECS_NOINLINE void operator delete( void* p, std::align_val_t ) noexcept {
+#if defined( _WIN32 )
+    _aligned_free( p );
+#else
+    std::free( p );
+#endif
+}
+void operator delete( void* p, std::size_t, std::align_val_t align ) noexcept { operator delete( p, align ); }
+#endif
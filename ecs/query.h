@@ -0,0 +1,148 @@
+#pragma once
+
+#include "archetype.h"
+#include "sparse_set.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace ecs {
+
+// A `ForEach` filter: skip entities that have any of these components.
+//     ecs.ForEach< Position, Velocity, Without< Frozen > >( ... );
+template< typename... Ts >
+struct Without {};
+
+// A `ForEach` filter: only visit entities whose `T` was written since the system last ran.
+// The entity must have a `T`, but `fn` doesn't receive it unless it's also listed on its own.
+//     ecs.ForEach< const Position, Sprite, Changed< Position > >( mLastRun, [&]( const Position& p, Sprite& s ) { ... } );
+// Several `Changed<>` filters must all pass.
+//
+// Changes are tracked per chunk of `ChunkSize` entities, so an entity is also visited
+// if a neighbor in its chunk was written. Anything that can write counts as a write:
+// a non-const component in a query, or `ECS::Get()`/`TryGet()`/`Add()`.
+template< typename T >
+struct Changed {};
+
+namespace detail {
+    template< typename... Ts > struct TypeList {};
+
+    template< typename A, typename B > struct Concat;
+    template< typename... As, typename... Bs >
+    struct Concat< TypeList< As... >, TypeList< Bs... > > { using type = TypeList< As..., Bs... >; };
+
+    // Splits the template arguments of `ForEach` into the components to visit
+    // (`Include`), the components that rule an entity out (`Exclude`),
+    // and the components that must have changed (`Changed`).
+    template< typename... Ts > struct QueryTraits {
+        using Include = TypeList<>;
+        using Exclude = TypeList<>;
+        using Changed = TypeList<>;
+    };
+    template< typename T, typename... Rest >
+    struct QueryTraits< T, Rest... > {
+        using Include = typename Concat< TypeList< T >, typename QueryTraits< Rest... >::Include >::type;
+        using Exclude = typename QueryTraits< Rest... >::Exclude;
+        using Changed = typename QueryTraits< Rest... >::Changed;
+    };
+    template< typename... Xs, typename... Rest >
+    struct QueryTraits< Without< Xs... >, Rest... > {
+        using Include = typename QueryTraits< Rest... >::Include;
+        using Exclude = typename Concat< TypeList< Xs... >, typename QueryTraits< Rest... >::Exclude >::type;
+        using Changed = typename QueryTraits< Rest... >::Changed;
+    };
+    template< typename G, typename... Rest >
+    struct QueryTraits< ecs::Changed< G >, Rest... > {
+        using Include = typename QueryTraits< Rest... >::Include;
+        using Exclude = typename QueryTraits< Rest... >::Exclude;
+        using Changed = typename Concat< TypeList< std::remove_const_t<G> >, typename QueryTraits< Rest... >::Changed >::type;
+    };
+
+    // `Fetch<C>` finds component `C` for the entity currently being visited.
+    // `C` may be const-qualified for read-only access.
+    //
+    // Non-const components are marked as changed (at `version`) for every chunk `Get()` visits.
+    //
+    // Table components come straight out of the current archetype's column by row.
+    template< typename C, bool Sparse = IsSparse< std::remove_const_t<C> > >
+    struct Fetch {
+        using Component = std::remove_const_t<C>;
+
+        Column* source = nullptr;
+        C* column = nullptr;
+        uint64_t version = 0;
+        // Visits go down a chunk in order, so only mark when the chunk changes.
+        size_t marked = SIZE_MAX;
+
+        void Bind( Archetype& a ) {
+            source = &a.GetColumn( a.ColumnIndex( GetComponentID< Component >() ) );
+            column = source->Data< Component >();
+            marked = SIZE_MAX;
+        }
+        bool Match( EntityID, uint32_t ) { return true; }
+        C& Get( uint32_t row ) {
+            if constexpr( !std::is_const_v<C> ) {
+                if( row / ChunkSize != marked ) {
+                    marked = row / ChunkSize;
+                    source->MarkChanged( row, version );
+                }
+            }
+            return column[row];
+        }
+    };
+    // Sparse components are looked up in their pool by entity index.
+    template< typename C >
+    struct Fetch< C, true > {
+        using Component = std::remove_const_t<C>;
+
+        SparseSet< Component >* pool = nullptr;
+        C* current = nullptr;
+        uint32_t index = SparseSetBase::None;
+        uint64_t version = 0;
+        size_t marked = SIZE_MAX;
+
+        void Bind( Archetype& ) {}
+        bool Match( EntityID e, uint32_t ) {
+            index = pool->IndexOf( e );
+            if( index == SparseSetBase::None ) return false;
+            current = pool->Data() + index;
+            return true;
+        }
+        C& Get( uint32_t ) {
+            if constexpr( !std::is_const_v<C> ) {
+                if( index / ChunkSize != marked ) {
+                    marked = index / ChunkSize;
+                    pool->MarkChanged( index, version );
+                }
+            }
+            return *current;
+        }
+    };
+
+    // `Since<G>` checks a `Changed< G >` filter: was the entity's `G` written after `since`?
+    // For table components this only depends on the chunk, so whole chunks can be skipped.
+    template< typename G, bool Sparse = IsSparse<G> >
+    struct Since {
+        const Column* column = nullptr;
+        uint64_t since = 0;
+
+        void Bind( const Archetype& a ) { column = &a.GetColumn( a.ColumnIndex( GetComponentID<G>() ) ); }
+        bool ChunkChanged( size_t chunk ) const { return column->ChunkVersion( chunk ) > since; }
+        bool Changed( EntityID, uint32_t row ) const { return ChunkChanged( row / ChunkSize ); }
+    };
+    template< typename G >
+    struct Since< G, true > {
+        const SparseSetBase* pool = nullptr;
+        uint64_t since = 0;
+
+        void Bind( const Archetype& ) {}
+        bool ChunkChanged( size_t ) const { return true; }
+        bool Changed( EntityID e, uint32_t ) const {
+            const uint32_t index = pool->IndexOf( e );
+            return index != SparseSetBase::None && pool->ChunkVersion( index / ChunkSize ) > since;
+        }
+    };
+}
+
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "ecs.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// Which component types a system touches. The scheduler uses this to decide
+// which systems may run at the same time: two systems conflict if one of them
+// writes a component type the other reads or writes.
+struct Access {
+    std::vector< ComponentID > reads;
+    std::vector< ComponentID > writes;
+    // An exclusive system conflicts with everything. Use it for systems that
+    // create or destroy entities or add or drop components directly, instead of
+    // recording them in `ECS::Commands()`.
+    bool exclusive = false;
+
+    bool ConflictsWith( const Access& other ) const {
+        if( exclusive || other.exclusive ) return true;
+        auto overlaps = []( const std::vector< ComponentID >& a, const std::vector< ComponentID >& b ) {
+            for( ComponentID id : a ) if( std::find( b.begin(), b.end(), id ) != b.end() ) return true;
+            return false;
+        };
+        return overlaps( writes, other.reads ) || overlaps( writes, other.writes ) || overlaps( reads, other.writes );
+    }
+};
+
+// Helpers to build an `Access`:
+//     scheduler.Add( "physics", Reads< Velocity >() + Writes< Position >(), physics );
+template< typename... Ts >
+Access Reads() { return Access{ { GetComponentID< std::remove_const_t<Ts> >()... }, {}, false }; }
+template< typename... Ts >
+Access Writes() { return Access{ {}, { GetComponentID< std::remove_const_t<Ts> >()... }, false }; }
+inline Access Exclusive() { return Access{ {}, {}, true }; }
+
+inline Access operator+( Access a, const Access& b ) {
+    a.reads.insert( a.reads.end(), b.reads.begin(), b.reads.end() );
+    a.writes.insert( a.writes.end(), b.writes.begin(), b.writes.end() );
+    a.exclusive = a.exclusive || b.exclusive;
+    return a;
+}
+
+// Runs a list of systems once per frame, overlapping the ones that don't conflict.
+//
+// Systems run as if in the order they were added: if system B conflicts with an
+// earlier system A, B waits for A. Each frame, `Run()` builds that dependency graph
+// and groups the systems into waves. Every system in a wave only depends on systems
+// in earlier waves, so a whole wave can run on the thread pool at once.
+//
+// A system that calls `ParallelForEach()` gets the whole pool only if it is alone in
+// its wave; otherwise its loop runs on the thread it was given.
+//
+// Structural changes recorded in `ECS::Commands()` are played back after the last wave.
+//
+// With a `Profiler`, every system run (and the playback) is measured, and each `Run()` is one frame.
+class Scheduler {
+public:
+    typedef std::function< void( ECS& ) > System;
+
+    void Add( std::string name, Access access, System system ) {
+        const uint32_t profile = mProfiler ? mProfiler->AddSystem( name ) : 0;
+        mSystems.push_back( Entry{ std::move( name ), std::move( access ), std::move( system ), profile } );
+    }
+
+    // Starts measuring with `profiler`, or stops if it's nullptr. The profiler must outlive the scheduler.
+    // Systems are measured by name, so setting the same profiler again picks up the same rows.
+    void SetProfiler( Profiler* profiler ) {
+        mProfiler = profiler;
+        if( !mProfiler ) return;
+        for( Entry& e : mSystems ) e.profile = mProfiler->AddSystem( e.name );
+        mPlaybackProfile = mProfiler->AddSystem( "[playback]" );
+    }
+
+    void Run( ECS& ecs ) {
+        BuildWaves();
+        // Make sure the pool exists before any system could ask for it from another thread.
+        ThreadPool& threads = ecs.Threads();
+        for( const std::vector< size_t >& wave : mWaves ) {
+            threads.ParallelFor( wave.size(), [&]( size_t i ) {
+                Entry& entry = mSystems[ wave[i] ];
+                if( !mProfiler ) {
+                    entry.system( ecs );
+                    return;
+                }
+                Profiler::Scope scope( *mProfiler, entry.profile );
+                entry.system( ecs );
+            } );
+        }
+        if( mProfiler ) {
+            {
+                Profiler::Scope scope( *mProfiler, mPlaybackProfile );
+                ecs.Playback();
+            }
+            mProfiler->EndFrame();
+        } else {
+            ecs.Playback();
+        }
+    }
+
+    // The waves from the most recent `Run()`, as indices in the order systems were added.
+    const std::vector< std::vector< size_t > >& Waves() const { return mWaves; }
+    const std::string& Name( size_t system ) const { return mSystems[ system ].name; }
+    size_t NumSystems() const { return mSystems.size(); }
+
+private:
+    struct Entry {
+        std::string name;
+        Access access;
+        System system;
+        // The system's number in `mProfiler`.
+        uint32_t profile;
+    };
+
+    void BuildWaves() {
+        // A system's wave is one more than the latest wave of any earlier system it conflicts with.
+        std::vector< size_t > wave( mSystems.size(), 0 );
+        size_t count = 0;
+        for( size_t j = 0; j < mSystems.size(); ++j ) {
+            for( size_t i = 0; i < j; ++i ) {
+                if( mSystems[j].access.ConflictsWith( mSystems[i].access ) ) wave[j] = std::max( wave[j], wave[i]+1 );
+            }
+            count = std::max( count, wave[j]+1 );
+        }
+
+        mWaves.assign( count, {} );
+        for( size_t j = 0; j < mSystems.size(); ++j ) mWaves[ wave[j] ].push_back( j );
+    }
+
+    std::vector< Entry > mSystems;
+    std::vector< std::vector< size_t > > mWaves;
+    Profiler* mProfiler = nullptr;
+    uint32_t mPlaybackProfile = 0;
+};
+
+}
@@ -0,0 +1,478 @@
+#pragma once
+
+#include "ecs.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ecs {
+
+// A whole file in memory. On POSIX systems it is memory-mapped copy-on-write,
+// so pages are only read from disk when touched, and writing to them never changes the file.
+// Elsewhere, the file is simply read into a buffer.
+class MappedFile {
+public:
+    explicit MappedFile( const std::string& path ) {
+#if defined(_WIN32)
+        std::ifstream in( path, std::ios::binary | std::ios::ate );
+        if( !in ) throw std::runtime_error( "Snapshot: can't open " + path );
+        mSize = size_t( in.tellg() );
+        in.seekg( 0 );
+        mData = static_cast< std::byte* >( ::operator new( std::max< size_t >( mSize, 1 ), std::align_val_t( Alignment ) ) );
+        if( !in.read( reinterpret_cast< char* >( mData ), std::streamsize( mSize ) ) ) {
+            ::operator delete( mData, std::align_val_t( Alignment ) );
+            throw std::runtime_error( "Snapshot: can't read " + path );
+        }
+#else
+        const int fd = ::open( path.c_str(), O_RDONLY );
+        if( fd < 0 ) throw std::runtime_error( "Snapshot: can't open " + path );
+        struct stat info;
+        if( ::fstat( fd, &info ) != 0 || info.st_size == 0 ) {
+            ::close( fd );
+            throw std::runtime_error( "Snapshot: can't read " + path );
+        }
+        mSize = size_t( info.st_size );
+        void* data = ::mmap( nullptr, mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+        ::close( fd );
+        if( data == MAP_FAILED ) throw std::runtime_error( "Snapshot: can't map " + path );
+        mData = static_cast< std::byte* >( data );
+#endif
+    }
+    ~MappedFile() {
+#if defined(_WIN32)
+        ::operator delete( mData, std::align_val_t( Alignment ) );
+#else
+        ::munmap( mData, mSize );
+#endif
+    }
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+    std::byte* Data() const { return mData; }
+    size_t Size() const { return mSize; }
+
+    // The start of the file is at least this aligned.
+    static constexpr size_t Alignment = 64;
+
+private:
+    std::byte* mData = nullptr;
+    size_t mSize = 0;
+};
+
+// Saves and loads a whole `ECS` as one binary file.
+//
+// The file is a type table followed by every archetype column and sparse pool as a raw
+// block of bytes, each aligned to 64 bytes. Loading never constructs components one by
+// one. It maps the file and then either adopts the columns in place (the archetypes point
+// straight into the mapping until they grow) or copies each column with one `memcpy`.
+//
+// Component IDs depend on the order types are first used, so the file identifies types
+// by the names they are registered under. Every component type in the ECS must be
+// registered, and it must be trivially copyable: no pointers, `std::string`s, or
+// `std::vector`s. Entity IDs are saved as is, so components may refer to other entities.
+//
+//     ecs::Snapshot snapshot;
+//     snapshot.Register< Position >( "position" );
+//     snapshot.Register< Velocity >( "velocity" );
+//     snapshot.Save( ecs, "level1.ecs" );
+//     ...
+//     ECS loaded;
+//     snapshot.Load( loaded, "level1.ecs" );
+//
+// The bytes are whatever the components look like in memory, so a snapshot can only be
+// loaded by a build for the same kind of machine. Changing a component's size or
+// alignment makes old snapshots fail to load.
+class Snapshot {
+public:
+    static constexpr uint32_t FormatVersion = 1;
+
+    enum class LoadMode {
+        // Point the columns into the mapped file. The fastest, but the mapping stays alive until the ECS is destroyed.
+        Adopt,
+        // Copy each column into memory of its own.
+        Copy
+    };
+
+    template< typename T >
+    void Register( const std::string& name ) {
+        static_assert( std::is_trivially_copyable_v<T>, "Snapshots store components as raw bytes, so they must be trivially copyable." );
+        Type type;
+        type.name = name;
+        type.info = &GetComponentInfo<T>();
+        type.sparse = IsSparse<T>;
+        if constexpr( IsSparse<T> ) {
+            type.view_pool = &ViewPool<T>;
+            type.load_pool = &LoadPool<T>;
+        }
+        mTypes.push_back( type );
+    }
+
+    // Throws `std::runtime_error` if the file can't be written or a component type isn't registered.
+    void Save( const ECS& ecs, const std::string& path ) const {
+        // Work out the type table first: every type that has data, in order of first appearance.
+        std::vector< const Type* > types;
+        auto type_index = [&]( ComponentID id ) {
+            const Type* type = Find( id );
+            if( !type ) throw std::runtime_error( "Snapshot: component " + ComponentName( id ) + " is not registered" );
+            auto found = std::find( types.begin(), types.end(), type );
+            if( found != types.end() ) return uint32_t( found - types.begin() );
+            types.push_back( type );
+            return uint32_t( types.size()-1 );
+        };
+        // Empty archetypes are saved without columns, so they don't need their types registered.
+        std::vector< std::vector< uint32_t > > archetype_types( ecs.mArchetypes.size() );
+        for( size_t i = 0; i < ecs.mArchetypes.size(); ++i ) {
+            if( ecs.mArchetypes[i]->Size() == 0 ) continue;
+            for( ComponentID id : ecs.mArchetypes[i]->Types() ) archetype_types[i].push_back( type_index( id ) );
+        }
+        std::vector< uint32_t > pools;
+        for( ComponentID id = 0; id < ecs.mPools.size(); ++id ) {
+            if( ecs.mPools[id] && ecs.mPools[id]->Size() > 0 ) pools.push_back( type_index( id ) );
+        }
+
+        Writer out( path );
+        Header header{};
+        std::memcpy( header.magic, Magic, sizeof( Magic ) );
+        header.version = FormatVersion;
+        header.byte_order = ByteOrder;
+        header.num_types = uint32_t( types.size() );
+        header.num_records = uint32_t( ecs.mRecords.size() );
+        header.num_free = uint32_t( ecs.mFree.size() );
+        header.num_archetypes = uint32_t( ecs.mArchetypes.size() );
+        header.num_pools = uint32_t( pools.size() );
+        out.Write( &header, sizeof( header ) );
+
+        for( const Type* type : types ) {
+            const uint32_t fields[4] = { uint32_t( type->info->size ), uint32_t( type->info->align ), uint32_t( type->sparse ), uint32_t( type->name.size() ) };
+            out.Write( fields, sizeof( fields ) );
+            out.Write( type->name.data(), type->name.size() );
+        }
+
+        out.Align( 8 );
+        for( const ECS::Record& r : ecs.mRecords ) {
+            const SavedRecord saved{ r.generation, r.archetype, r.row };
+            out.Write( &saved, sizeof( saved ) );
+        }
+        for( EntityID::IDType index : ecs.mFree ) out.Write( &index, sizeof( index ) );
+
+        for( size_t i = 0; i < ecs.mArchetypes.size(); ++i ) {
+            const Archetype& a = *ecs.mArchetypes[i];
+            const uint32_t num_columns = uint32_t( archetype_types[i].size() );
+            out.Align( 8 );
+            out.Write( &num_columns, sizeof( num_columns ) );
+            out.Write( archetype_types[i].data(), num_columns * sizeof( uint32_t ) );
+            out.Align( 8 );
+            const uint64_t rows = a.Size();
+            out.Write( &rows, sizeof( rows ) );
+            out.Block( a.Entities().data(), rows * sizeof( EntityID ) );
+            for( uint32_t c = 0; c < num_columns; ++c ) out.Block( a.GetColumn( c ).At( 0 ), rows * a.GetColumn( c ).Info().size );
+        }
+
+        for( uint32_t t : pools ) {
+            const PoolView pool = types[t]->view_pool( ecs );
+            out.Align( 8 );
+            out.Write( &t, sizeof( t ) );
+            out.Align( 8 );
+            const uint64_t count = pool.count;
+            out.Write( &count, sizeof( count ) );
+            out.Block( pool.entities, count * sizeof( EntityID ) );
+            out.Block( pool.values, count * types[t]->info->size );
+        }
+
+        out.Commit();
+    }
+
+    // Loads a snapshot into `ecs`, which must not have any entities yet.
+    // Throws `std::runtime_error` if the file is missing, damaged, from another format version,
+    // or mentions a type that isn't registered (or whose layout changed).
+    // The whole file is read and checked before `ecs` is touched, so a failed load leaves it empty.
+    void Load( ECS& ecs, const std::string& path, LoadMode mode = LoadMode::Adopt ) const {
+        if( !ecs.mRecords.empty() ) throw std::logic_error( "Snapshot: load into an ECS that has never had entities" );
+
+        std::shared_ptr< MappedFile > file = std::make_shared< MappedFile >( path );
+        Reader in( *file );
+        auto damaged = [&]() { return std::runtime_error( "Snapshot: " + path + " is damaged" ); };
+
+        Header header;
+        std::memcpy( &header, in.Take( sizeof( header ) ), sizeof( header ) );
+        if( std::memcmp( header.magic, Magic, sizeof( Magic ) ) != 0 ) throw std::runtime_error( "Snapshot: " + path + " is not a snapshot" );
+        if( header.version != FormatVersion ) throw std::runtime_error( "Snapshot: " + path + " has format version " + std::to_string( header.version ) );
+        if( header.byte_order != ByteOrder ) throw std::runtime_error( "Snapshot: " + path + " was saved on a different kind of machine" );
+        if( header.num_records > size_t( EntityID::MaxIndex ) + 1 ) throw damaged();
+
+        std::vector< const Type* > types;
+        for( uint32_t t = 0; t < header.num_types; ++t ) {
+            uint32_t fields[4];
+            std::memcpy( fields, in.Take( sizeof( fields ) ), sizeof( fields ) );
+            const std::string name( reinterpret_cast< const char* >( in.Take( fields[3] ) ), fields[3] );
+            const Type* type = Find( name );
+            if( !type ) throw std::runtime_error( "Snapshot: component \"" + name + "\" is not registered" );
+            if( type->info->size != fields[0] || type->info->align != fields[1] || uint32_t( type->sparse ) != fields[2] ) {
+                throw std::runtime_error( "Snapshot: component \"" + name + "\" has changed since the snapshot was saved" );
+            }
+            types.push_back( type );
+        }
+        auto type_at = [&]( uint32_t t ) {
+            if( t >= types.size() ) throw damaged();
+            return types[t];
+        };
+
+        in.Align( 8 );
+        // Take the bytes before allocating, so a damaged count can't ask for more memory than the file holds.
+        const std::byte* saved_records = in.Take( size_t( header.num_records ) * sizeof( SavedRecord ) );
+        std::vector< SavedRecord > records( header.num_records );
+        std::memcpy( records.data(), saved_records, records.size() * sizeof( SavedRecord ) );
+        const std::byte* saved_free = in.Take( size_t( header.num_free ) * sizeof( EntityID::IDType ) );
+        std::vector< EntityID::IDType > free_list( header.num_free );
+        std::memcpy( free_list.data(), saved_free, free_list.size() * sizeof( EntityID::IDType ) );
+
+        // Every live record must point at a row that holds its entity, and every row at a live record.
+        size_t num_alive = 0;
+        for( const SavedRecord& r : records ) {
+            if( r.archetype == Archetype::None ) continue;
+            if( r.archetype >= header.num_archetypes ) throw damaged();
+            ++num_alive;
+        }
+        std::vector< bool > freed( records.size() );
+        for( EntityID::IDType index : free_list ) {
+            if( index >= records.size() || records[index].archetype != Archetype::None || freed[index] ) throw damaged();
+            freed[index] = true;
+        }
+        auto live = [&]( EntityID e ) {
+            return e.Valid() && e.Index() < records.size() && records[ e.Index() ].archetype != Archetype::None && records[ e.Index() ].generation == e.Generation();
+        };
+
+        // Read and check everything first, so nothing below can fail halfway through filling `ecs`.
+        struct SavedArchetype {
+            std::vector< const Type* > columns;
+            std::vector< std::byte* > values;
+            const EntityID* entities = nullptr;
+            size_t rows = 0;
+        };
+        std::vector< SavedArchetype > archetypes;
+        size_t num_rows = 0;
+        for( uint32_t i = 0; i < header.num_archetypes; ++i ) {
+            SavedArchetype& saved = archetypes.emplace_back();
+            in.Align( 8 );
+            uint32_t num_columns;
+            std::memcpy( &num_columns, in.Take( sizeof( num_columns ) ), sizeof( num_columns ) );
+            for( uint32_t c = 0; c < num_columns; ++c ) {
+                uint32_t t;
+                std::memcpy( &t, in.Take( sizeof( t ) ), sizeof( t ) );
+                const Type* type = type_at( t );
+                if( type->sparse || std::find( saved.columns.begin(), saved.columns.end(), type ) != saved.columns.end() ) throw damaged();
+                saved.columns.push_back( type );
+            }
+            in.Align( 8 );
+            uint64_t rows;
+            std::memcpy( &rows, in.Take( sizeof( rows ) ), sizeof( rows ) );
+            if( rows > records.size() ) throw damaged();
+            saved.rows = size_t( rows );
+            num_rows += saved.rows;
+
+            saved.entities = reinterpret_cast< const EntityID* >( in.Block( saved.rows * sizeof( EntityID ) ) );
+            for( size_t row = 0; row < saved.rows; ++row ) {
+                const EntityID e = saved.entities[row];
+                if( !live( e ) || records[ e.Index() ].archetype != i || records[ e.Index() ].row != row ) throw damaged();
+            }
+            for( const Type* type : saved.columns ) saved.values.push_back( in.Block( saved.rows * type->info->size ) );
+        }
+        if( num_rows != num_alive ) throw damaged();
+
+        struct SavedPool {
+            const Type* type;
+            const EntityID* entities;
+            const std::byte* values;
+            size_t count;
+        };
+        std::vector< SavedPool > pools;
+        std::vector< uint32_t > last_seen( records.size(), UINT32_MAX );
+        for( uint32_t p = 0; p < header.num_pools; ++p ) {
+            in.Align( 8 );
+            uint32_t t;
+            std::memcpy( &t, in.Take( sizeof( t ) ), sizeof( t ) );
+            const Type* type = type_at( t );
+            if( !type->sparse ) throw damaged();
+            for( const SavedPool& pool : pools ) if( pool.type == type ) throw damaged();
+            in.Align( 8 );
+            uint64_t count;
+            std::memcpy( &count, in.Take( sizeof( count ) ), sizeof( count ) );
+            if( count > records.size() ) throw damaged();
+            const EntityID* entities = reinterpret_cast< const EntityID* >( in.Block( count * sizeof( EntityID ) ) );
+            // An entity can only have one of each component.
+            for( size_t j = 0; j < count; ++j ) {
+                if( !live( entities[j] ) || last_seen[ entities[j].Index() ] == p ) throw damaged();
+                last_seen[ entities[j].Index() ] = p;
+            }
+            pools.push_back( SavedPool{ type, entities, in.Block( count * type->info->size ), size_t( count ) } );
+        }
+
+        // Now fill in `ecs`.
+        std::vector< uint32_t > archetype_of( archetypes.size() );
+        for( size_t i = 0; i < archetypes.size(); ++i ) {
+            const SavedArchetype& saved = archetypes[i];
+            // Component IDs may be numbered differently in this run, so sort again.
+            std::vector< const ComponentInfo* > infos;
+            for( const Type* type : saved.columns ) infos.push_back( type->info );
+            std::sort( infos.begin(), infos.end(), ECS::ByID );
+            archetype_of[i] = ecs.FindOrCreateArchetype( infos );
+            Archetype& a = *ecs.mArchetypes[ archetype_of[i] ];
+
+            a.PushEntities( saved.entities, saved.rows );
+            if( saved.rows == 0 ) continue;
+            for( size_t c = 0; c < saved.columns.size(); ++c ) {
+                const ComponentInfo& info = *saved.columns[c]->info;
+                Column& column = a.GetColumn( a.ColumnIndex( info.id ) );
+                const bool aligned = reinterpret_cast< uintptr_t >( saved.values[c] ) % info.align == 0;
+                if( mode == LoadMode::Adopt && aligned && column.Size() == 0 ) {
+                    // Keep the mapping alive for as long as columns point into it.
+                    if( ecs.mSnapshotMemory.empty() || ecs.mSnapshotMemory.back() != file ) ecs.mSnapshotMemory.push_back( file );
+                    column.Borrow( saved.values[c], saved.rows );
+                } else {
+                    column.AppendBytes( saved.values[c], saved.rows );
+                }
+            }
+        }
+
+        for( const SavedPool& pool : pools ) pool.type->load_pool( ecs, pool.entities, pool.values, pool.count );
+
+        ecs.mRecords.resize( records.size() );
+        for( size_t i = 0; i < records.size(); ++i ) {
+            ECS::Record& r = ecs.mRecords[i];
+            r.generation = records[i].generation;
+            r.row = records[i].row;
+            r.archetype = records[i].archetype == Archetype::None ? Archetype::None : archetype_of[ records[i].archetype ];
+        }
+        ecs.mNumAlive = num_alive;
+        ecs.mFree.assign( free_list.begin(), free_list.end() );
+    }
+
+private:
+    struct PoolView {
+        const EntityID* entities;
+        const void* values;
+        size_t count;
+    };
+
+    struct Type {
+        std::string name;
+        const ComponentInfo* info = nullptr;
+        bool sparse = false;
+        PoolView (*view_pool)( const ECS& ) = nullptr;
+        void (*load_pool)( ECS&, const EntityID*, const std::byte*, size_t ) = nullptr;
+    };
+
+    template< typename T >
+    static PoolView ViewPool( const ECS& ecs ) {
+        const SparseSet<T>* pool = ecs.FindPool<T>();
+        return PoolView{ pool->Entities().data(), pool->Data(), pool->Size() };
+    }
+    template< typename T >
+    static void LoadPool( ECS& ecs, const EntityID* entities, const std::byte* values, size_t count ) {
+        ecs.Pool<T>().AppendBytes( entities, values, count );
+    }
+
+    const Type* Find( ComponentID id ) const {
+        for( const Type& type : mTypes ) if( type.info->id == id ) return &type;
+        return nullptr;
+    }
+    const Type* Find( const std::string& name ) const {
+        for( const Type& type : mTypes ) if( type.name == name ) return &type;
+        return nullptr;
+    }
+
+    static constexpr char Magic[4] = { 'E', 'C', 'S', 'S' };
+    static constexpr uint32_t ByteOrder = 0x01020304;
+    // Column blocks start at multiples of this, so they can be used in place.
+    static constexpr size_t BlockAlignment = MappedFile::Alignment;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t num_types;
+        uint32_t num_records;
+        uint32_t num_free;
+        uint32_t num_archetypes;
+        uint32_t num_pools;
+    };
+    struct SavedRecord {
+        uint32_t generation;
+        uint32_t archetype;
+        uint32_t row;
+    };
+
+    // Writes to a temporary file that replaces `path` on `Commit()`,
+    // so a failed save never leaves a half-written snapshot behind.
+    class Writer {
+    public:
+        explicit Writer( const std::string& path ) : mPath( path ), mTemporary( path + ".tmp" ), mOut( mTemporary, std::ios::binary | std::ios::trunc ) {
+            if( !mOut ) throw std::runtime_error( "Snapshot: can't write " + mTemporary );
+        }
+        void Write( const void* data, size_t size ) {
+            mOut.write( static_cast< const char* >( data ), std::streamsize( size ) );
+            mOffset += size;
+        }
+        void Align( size_t alignment ) {
+            static const char zeros[ BlockAlignment ] = {};
+            const size_t padding = ( alignment - mOffset % alignment ) % alignment;
+            Write( zeros, padding );
+        }
+        // A raw block, aligned for use in place.
+        void Block( const void* data, size_t size ) {
+            Align( BlockAlignment );
+            if( size > 0 ) Write( data, size );
+        }
+        void Commit() {
+            mOut.close();
+            if( !mOut ) throw std::runtime_error( "Snapshot: can't write " + mTemporary );
+            std::filesystem::rename( mTemporary, mPath );
+        }
+    private:
+        std::string mPath;
+        std::string mTemporary;
+        std::ofstream mOut;
+        size_t mOffset = 0;
+    };
+
+    // Walks through the mapped file, refusing to read past its end.
+    class Reader {
+    public:
+        explicit Reader( const MappedFile& file ) : mFile( file ) {}
+        std::byte* Take( size_t size ) {
+            if( size > mFile.Size() - mOffset ) throw std::runtime_error( "Snapshot: the file is truncated" );
+            std::byte* result = mFile.Data() + mOffset;
+            mOffset += size;
+            return result;
+        }
+        void Align( size_t alignment ) { Take( ( alignment - mOffset % alignment ) % alignment ); }
+        std::byte* Block( size_t size ) {
+            Align( BlockAlignment );
+            return Take( size );
+        }
+    private:
+        const MappedFile& mFile;
+        size_t mOffset = 0;
+    };
+
+    std::vector< Type > mTypes;
+};
+
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "component.h"
+#include "entity.h"
+#include "version.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// Where the ECS keeps a component type.
+// `Table` components live in archetype columns. They are fastest to iterate,
+// but adding or dropping one moves every other component the entity has.
+// `SparseSet` components live in their own pool. Adding and dropping them is O(1)
+// and never moves anything else, which suits tags and components that come and go often.
+enum class Storage { Table, SparseSet };
+
+// A component opts into sparse storage by declaring
+//     static constexpr ecs::Storage storage = ecs::Storage::SparseSet;
+// You can also specialize `StorageOf` for types you can't modify.
+template< typename T, typename = void >
+struct StorageOf { static constexpr Storage value = Storage::Table; };
+template< typename T >
+struct StorageOf< T, std::void_t< decltype( T::storage ) > > { static constexpr Storage value = T::storage; };
+
+template< typename T >
+constexpr bool IsSparse = StorageOf<T>::value == Storage::SparseSet;
+
+// The part of a sparse set that doesn't depend on the component type.
+// It maps an entity to its position in the dense arrays.
+//
+// The sparse index is paged: one page covers `PageSize` consecutive entity indices and is
+// only allocated once one of them is used. That keeps lookups a couple of array
+// indexing operations (no hashing, no pointer chasing through nodes) without
+// allocating an index slot for every entity that ever existed.
+//
+// Like an archetype column, a pool given the ECS's version clock keeps a write version
+// per chunk of `ChunkSize` entries of the dense arrays.
+class SparseSetBase {
+public:
+    static constexpr uint32_t None = UINT32_MAX;
+    static constexpr size_t PageSize = 4096;
+
+    explicit SparseSetBase( const VersionClock* clock = nullptr ) : mClock( clock ) {}
+    virtual ~SparseSetBase() = default;
+
+    bool Has( EntityID e ) const { return IndexOf( e ) != None; }
+    size_t Size() const { return mDense.size(); }
+    // The entities in this pool, packed in the same order as their components.
+    const std::vector< EntityID >& Entities() const { return mDense; }
+
+    // Position of `e` in the dense arrays, or `None`.
+    // A stale handle (same index, older generation) is not found.
+    uint32_t IndexOf( EntityID e ) const {
+        const size_t page = e.Index() / PageSize;
+        if( page >= mSparse.size() || !mSparse[page] ) return None;
+        const uint32_t index = mSparse[page][ e.Index() % PageSize ];
+        return index != None && mDense[index] == e ? index : None;
+    }
+
+    // The entity in this pool with the same index as `e`, whatever its generation, or an invalid ID.
+    // Finds entries left behind by an entity that was destroyed without being removed from the pool.
+    EntityID Occupant( EntityID e ) const {
+        const size_t page = e.Index() / PageSize;
+        if( page >= mSparse.size() || !mSparse[page] ) return EntityID();
+        const uint32_t index = mSparse[page][ e.Index() % PageSize ];
+        return index != None ? mDense[index] : EntityID();
+    }
+
+    // Removes `e` (and its component) if it is present.
+    virtual void Remove( EntityID e ) = 0;
+
+    // Type-erased access, for copying components without knowing their type (see `Prefab`).
+    // `Info()` is nullptr for components that aren't default constructible.
+    virtual const ComponentInfo* Info() const = 0;
+    virtual const void* ValueAt( uint32_t index ) const = 0;
+    // Adds a copy of `*value` for each of the `count` entities, none of which may have one already.
+    virtual void EmplaceCopies( const EntityID* entities, size_t count, const void* value ) = 0;
+
+    // Change tracking, by position in the dense arrays. These do nothing without a clock.
+    void MarkChanged( uint32_t index ) { if( mClock ) mVersions.Mark( index, mClock->load( std::memory_order_relaxed ) ); }
+    void MarkChanged( uint32_t index, uint64_t version ) { if( mClock ) mVersions.Mark( index, version ); }
+    uint64_t ChunkVersion( size_t chunk ) const { return mClock ? mVersions.Get( chunk ) : UINT64_MAX; }
+
+protected:
+    uint32_t& Slot( EntityID e ) {
+        assert( e.Valid() );
+        const size_t page = e.Index() / PageSize;
+        if( page >= mSparse.size() ) mSparse.resize( page+1 );
+        if( !mSparse[page] ) {
+            mSparse[page] = std::make_unique< uint32_t[] >( PageSize );
+            std::fill( mSparse[page].get(), mSparse[page].get() + PageSize, None );
+        }
+        return mSparse[page][ e.Index() % PageSize ];
+    }
+
+    const VersionClock* mClock;
+    ChunkVersions mVersions;
+    std::vector< std::unique_ptr< uint32_t[] > > mSparse;
+    std::vector< EntityID > mDense;
+};
+
+// A pool of `T` components keyed by entity index.
+// Components are packed contiguously, and removal moves the last one into the hole.
+template< typename T >
+class SparseSet : public SparseSetBase {
+public:
+    using SparseSetBase::SparseSetBase;
+
+    // Handing out a non-const pointer counts as a write.
+    T* TryGet( EntityID e ) {
+        const uint32_t index = IndexOf( e );
+        if( index == None ) return nullptr;
+        MarkChanged( index );
+        return &mValues[index];
+    }
+    const T* TryGet( EntityID e ) const {
+        const uint32_t index = IndexOf( e );
+        return index == None ? nullptr : &mValues[index];
+    }
+
+    // Adds a component constructed from `args`. `e` must not already have one.
+    template< typename... Args >
+    T& Emplace( EntityID e, Args&&... args ) {
+        uint32_t& slot = Slot( e );
+        assert( slot == None );
+        slot = uint32_t( mDense.size() );
+        mDense.push_back( e );
+        if constexpr( std::is_constructible_v< T, Args... > ) mValues.emplace_back( std::forward<Args>( args )... );
+        else mValues.push_back( T{ std::forward<Args>( args )... } );
+        if( mClock ) mVersions.Reserve( mDense.size() );
+        MarkChanged( slot );
+        return mValues.back();
+    }
+
+    void Remove( EntityID e ) override {
+        const uint32_t index = IndexOf( e );
+        if( index == None ) return;
+
+        // Swap and pop.
+        const uint32_t last = uint32_t( mDense.size()-1 );
+        if( index != last ) {
+            mDense[index] = mDense[last];
+            mValues[index] = std::move( mValues[last] );
+            Slot( mDense[index] ) = index;
+            MarkChanged( index );
+        }
+        mDense.pop_back();
+        mValues.pop_back();
+        Slot( e ) = None;
+    }
+
+    void Reserve( size_t count ) {
+        mDense.reserve( count );
+        mValues.reserve( count );
+    }
+
+    const ComponentInfo* Info() const override {
+        if constexpr( std::is_default_constructible_v<T> ) return &GetComponentInfo<T>();
+        else return nullptr;
+    }
+    const void* ValueAt( uint32_t index ) const override { return &mValues[index]; }
+
+    void EmplaceCopies( const EntityID* entities, size_t count, const void* value ) override {
+        if constexpr( std::is_copy_constructible_v<T> ) {
+            if( count == 0 ) return;
+            const size_t needed = mDense.size() + count;
+            if( needed > mDense.capacity() ) Reserve( std::max( needed, 2*mDense.capacity() ) );
+            const uint32_t first = uint32_t( mDense.size() );
+            for( size_t i = 0; i < count; ++i ) {
+                uint32_t& slot = Slot( entities[i] );
+                assert( slot == None );
+                slot = uint32_t( mDense.size() );
+                mDense.push_back( entities[i] );
+            }
+            mValues.insert( mValues.end(), count, *static_cast< const T* >( value ) );
+            if( mClock ) {
+                mVersions.Reserve( mDense.size() );
+                mVersions.MarkRows( first, mDense.size(), mClock->load( std::memory_order_relaxed ) );
+            }
+        } else {
+            throw std::logic_error( "SparseSet: component can't be copied" );
+        }
+    }
+
+    // Adds the `count` components stored as raw bytes at `values`, one for each of `entities`,
+    // none of which may have one already. For trivially copyable components only (see `Snapshot`).
+    void AppendBytes( const EntityID* entities, const std::byte* values, size_t count ) {
+        static_assert( std::is_trivially_copyable_v<T>, "AppendBytes copies raw bytes, so the component must be trivially copyable." );
+        if( count == 0 ) return;
+        const size_t first = mDense.size();
+        for( size_t i = 0; i < count; ++i ) Slot( entities[i] ) = uint32_t( first + i );
+        mDense.insert( mDense.end(), entities, entities + count );
+        mValues.resize( first + count );
+        std::memcpy( static_cast< void* >( mValues.data() + first ), values, count*sizeof(T) );
+        if( mClock ) {
+            mVersions.Reserve( mDense.size() );
+            mVersions.MarkRows( first, mDense.size(), mClock->load( std::memory_order_relaxed ) );
+        }
+    }
+
+    T* Data() { return mValues.data(); }
+    const T* Data() const { return mValues.data(); }
+
+private:
+    std::vector< T > mValues;
+};
+
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include "ecs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// A uniform grid over the entities that have a `Position` component, for proximity queries
+// that don't look at every entity.
+//
+// `Position` can be any component with float-like `x` and `y` members.
+// If `Size` is given, entities that also have a `Size` (with `x` and `y` as full width and height)
+// are treated as boxes centered on their position. Everything else is a point.
+//
+// Space is cut into square cells of `cell_size`. Each entity is filed under the cell
+// holding its center, and cells are found by hashing, so the world can be unbounded.
+// Pick a cell size around the typical query radius.
+//
+// Call `Update()` once per frame, after things have moved. It only looks at entities whose
+// `Position` (or `Size`) changed since the last `Update()` (see `Changed<>`), and usually
+// they stay in the same cell. Destroyed entities are weeded out a slice at a time. Queries
+// answer with positions as of the last `Update()` and never report dead entities.
+//
+//     SpatialGrid< Position > grid( ecs, 64 );
+//     ...
+//     grid.Update();
+//     grid.QueryRadius( p.x, p.y, 100, [&]( EntityID other ) { ... } );
+template< typename Position, typename Size = void >
+class SpatialGrid {
+public:
+    SpatialGrid( ECS& ecs, float cell_size ) : mECS( ecs ), mCellSize( cell_size ), mInverseCellSize( 1 / cell_size ) {}
+
+    void Update() {
+        // A reference to a const ECS, so that looking at components doesn't count as changing them.
+        const ECS& ecs = mECS;
+        mECS.ForEach< const Position, Changed< Position > >( mPositionsSeen, [&]( EntityID e, const Position& p ) {
+            Place( e, float( p.x ), float( p.y ), HalfExtent( ecs, e ) );
+        } );
+        if constexpr( !std::is_void_v< Size > ) {
+            mECS.ForEach< const Position, const Size, Changed< Size > >( mSizesSeen, [&]( EntityID e, const Position& p, const Size& s ) {
+                Place( e, float( p.x ), float( p.y ), Extent{ float( s.x ) / 2, float( s.y ) / 2 } );
+            } );
+        }
+        Sweep( std::max< size_t >( MinimumSweep, mItems.size() / SweepFraction ) );
+    }
+
+    // Calls `fn( e )` for every entity within `radius` of (x,y). Boxes count if any part of them is.
+    template< typename F >
+    void QueryRadius( float x, float y, float radius, F&& fn ) const {
+        const float r2 = radius * radius;
+        VisitCells( x - radius, y - radius, x + radius, y + radius, [&]( const Item& item ) {
+            // Distance from (x,y) to the box.
+            const float dx = std::max( std::abs( item.x - x ) - item.extent.x, 0.f );
+            const float dy = std::max( std::abs( item.y - y ) - item.extent.y, 0.f );
+            if( dx*dx + dy*dy <= r2 ) fn( item.entity );
+        } );
+    }
+
+    // Calls `fn( e )` for every entity overlapping the box from (min_x,min_y) to (max_x,max_y).
+    template< typename F >
+    void QueryAABB( float min_x, float min_y, float max_x, float max_y, F&& fn ) const {
+        VisitCells( min_x, min_y, max_x, max_y, [&]( const Item& item ) {
+            if( item.x + item.extent.x >= min_x && item.x - item.extent.x <= max_x &&
+                item.y + item.extent.y >= min_y && item.y - item.extent.y <= max_y ) fn( item.entity );
+        } );
+    }
+
+    // Fills `out` with the (up to) `k` entities whose positions are closest to (x,y), nearest first.
+    // Searches rings of cells outward and stops as soon as no farther ring could do better.
+    // When the occupied cells are few or far apart, it goes through them directly instead.
+    void Nearest( float x, float y, size_t k, std::vector< EntityID >& out ) const {
+        out.clear();
+        if( k == 0 || mItems.empty() ) return;
+
+        // A max-heap on distance holds the best `k` so far.
+        std::vector< std::pair< float, EntityID > > best;
+        size_t seen = 0;
+        auto consider = [&]( const Item& item ) {
+            ++seen;
+            if( !Current( item ) ) return;
+            const float d2 = ( item.x - x )*( item.x - x ) + ( item.y - y )*( item.y - y );
+            if( best.size() == k && d2 >= best.front().first ) return;
+            if( best.size() == k ) {
+                std::pop_heap( best.begin(), best.end(), ByDistance );
+                best.pop_back();
+            }
+            best.emplace_back( d2, item.entity );
+            std::push_heap( best.begin(), best.end(), ByDistance );
+        };
+
+        const int64_t cx = CellCoordinate( x );
+        const int64_t cy = CellCoordinate( y );
+        // No occupied cell is farther than this many rings away.
+        const int64_t last_ring = std::max( { cx - mLow.x, mHigh.x - cx, cy - mLow.y, mHigh.y - cy, int64_t(0) } );
+        // Everything `ring` rings out is at least `(ring-1) * cell size` away.
+        auto out_of_reach = [&]( int64_t ring ) {
+            if( best.size() < k ) return false;
+            const float bound = float( ring - 1 ) * mCellSize;
+            return bound > 0 && bound * bound >= best.front().first;
+        };
+        for( int64_t ring = 0; ring <= last_ring && seen < mItems.size(); ++ring ) {
+            if( out_of_reach( ring ) ) break;
+            // Once the rings searched so far cover more cells than are occupied (the points are sparse
+            // or far away), it's faster to go through the remaining occupied cells directly.
+            if( double( 2*ring + 1 ) * double( 2*ring + 1 ) > double( mCells.size() ) ) {
+                for( const auto& [key, list] : mCells ) {
+                    const int64_t i = int32_t( key >> 32 ), j = int32_t( key & 0xffffffffu );
+                    const int64_t cell_ring = std::max( std::abs( i - cx ), std::abs( j - cy ) );
+                    if( cell_ring < ring || out_of_reach( cell_ring ) ) continue;
+                    for( uint32_t slot : list ) consider( mItems[slot] );
+                }
+                break;
+            }
+            for( int64_t j = cy - ring; j <= cy + ring; ++j ) {
+                // The top and bottom rows of the ring are whole; the rows in between only have their two ends.
+                const int64_t step = ( j == cy - ring || j == cy + ring ) ? 1 : std::max< int64_t >( 2*ring, 1 );
+                for( int64_t i = cx - ring; i <= cx + ring; i += step ) VisitCell( i, j, consider );
+            }
+        }
+
+        std::sort_heap( best.begin(), best.end(), ByDistance );
+        for( const auto& [d2, e] : best ) out.push_back( e );
+    }
+
+    // Stops tracking `e` right away instead of waiting for it to be swept.
+    void Remove( EntityID e ) {
+        const uint32_t slot = SlotOf( e );
+        if( slot != None && mItems[slot].entity == e ) RemoveSlot( slot );
+    }
+
+    size_t NumEntities() const { return mItems.size(); }
+    size_t NumCells() const { return mCells.size(); }
+    float CellSize() const { return mCellSize; }
+
+private:
+    static constexpr uint32_t None = UINT32_MAX;
+    static constexpr size_t MinimumSweep = 256;
+    // Each `Update()` checks at least this fraction of the entities for being dead.
+    static constexpr size_t SweepFraction = 16;
+
+    struct Extent { float x = 0, y = 0; };
+    struct Item {
+        EntityID entity;
+        float x, y;
+        Extent extent;
+        uint64_t cell;
+        // Where this item is in its cell's list.
+        uint32_t index_in_cell;
+    };
+    struct CellRange { int64_t x, y; };
+
+    static bool ByDistance( const std::pair< float, EntityID >& a, const std::pair< float, EntityID >& b ) { return a.first < b.first; }
+
+    Extent HalfExtent( const ECS& ecs, EntityID e ) const {
+        if constexpr( !std::is_void_v< Size > ) {
+            if( const Size* s = ecs.TryGet< Size >( e ) ) return Extent{ float( s->x ) / 2, float( s->y ) / 2 };
+        }
+        return Extent{};
+    }
+
+    int64_t CellCoordinate( float v ) const { return int64_t( std::floor( v * mInverseCellSize ) ); }
+    static uint64_t Key( int64_t i, int64_t j ) { return ( uint64_t( uint32_t( i ) ) << 32 ) | uint32_t( j ); }
+
+    uint32_t SlotOf( EntityID e ) const { return e.Index() < mSlots.size() ? mSlots[ e.Index() ] : None; }
+
+    // Still alive and still has a position?
+    bool Current( const Item& item ) const { return mECS.Alive( item.entity ) && mECS.Has< Position >( item.entity ); }
+
+    void Place( EntityID e, float x, float y, Extent extent ) {
+        uint32_t slot = SlotOf( e );
+        // A recycled entity index replaces whatever was there.
+        if( slot != None && mItems[slot].entity != e ) {
+            RemoveSlot( slot );
+            slot = None;
+        }
+        const int64_t i = CellCoordinate( x ), j = CellCoordinate( y );
+        const uint64_t cell = Key( i, j );
+        if( slot == None ) {
+            if( e.Index() >= mSlots.size() ) mSlots.resize( e.Index()+1, None );
+            slot = mSlots[ e.Index() ] = uint32_t( mItems.size() );
+            mItems.push_back( Item{ e, x, y, extent, cell, 0 } );
+            AddToCell( slot, cell );
+        } else if( mItems[slot].cell != cell ) {
+            RemoveFromCell( slot );
+            AddToCell( slot, cell );
+        }
+        Item& item = mItems[slot];
+        item.x = x;
+        item.y = y;
+        item.extent = extent;
+
+        mLow = CellRange{ std::min( mLow.x, i ), std::min( mLow.y, j ) };
+        mHigh = CellRange{ std::max( mHigh.x, i ), std::max( mHigh.y, j ) };
+        mMaxExtent.x = std::max( mMaxExtent.x, extent.x );
+        mMaxExtent.y = std::max( mMaxExtent.y, extent.y );
+        // The sweep may already be past this item.
+        mSweepExtent.x = std::max( mSweepExtent.x, extent.x );
+        mSweepExtent.y = std::max( mSweepExtent.y, extent.y );
+    }
+
+    void AddToCell( uint32_t slot, uint64_t cell ) {
+        std::vector< uint32_t >& list = mCells[ cell ];
+        mItems[slot].cell = cell;
+        mItems[slot].index_in_cell = uint32_t( list.size() );
+        list.push_back( slot );
+    }
+    void RemoveFromCell( uint32_t slot ) {
+        auto found = mCells.find( mItems[slot].cell );
+        std::vector< uint32_t >& list = found->second;
+        const uint32_t index = mItems[slot].index_in_cell;
+        list[index] = list.back();
+        mItems[ list[index] ].index_in_cell = index;
+        list.pop_back();
+        if( list.empty() ) mCells.erase( found );
+    }
+    // Swap-and-pop out of `mItems`.
+    void RemoveSlot( uint32_t slot ) {
+        RemoveFromCell( slot );
+        mSlots[ mItems[slot].entity.Index() ] = None;
+        const uint32_t last = uint32_t( mItems.size()-1 );
+        if( slot != last ) {
+            mItems[slot] = mItems[last];
+            mSlots[ mItems[slot].entity.Index() ] = slot;
+            mCells[ mItems[slot].cell ][ mItems[slot].index_in_cell ] = slot;
+        }
+        mItems.pop_back();
+    }
+
+    // Checks `count` items, continuing where the last sweep stopped, and drops the dead ones.
+    // Once every item has been checked, the largest box size is recomputed too.
+    void Sweep( size_t count ) {
+        for( ; count > 0 && !mItems.empty(); --count ) {
+            if( mSweep >= mItems.size() ) {
+                mSweep = 0;
+                mMaxExtent = mSweepExtent;
+                mSweepExtent = Extent{};
+            }
+            if( !Current( mItems[ mSweep ] ) ) {
+                RemoveSlot( uint32_t( mSweep ) );
+                continue;
+            }
+            mSweepExtent.x = std::max( mSweepExtent.x, mItems[ mSweep ].extent.x );
+            mSweepExtent.y = std::max( mSweepExtent.y, mItems[ mSweep ].extent.y );
+            ++mSweep;
+        }
+    }
+
+    // Calls `fn( item )` for every live item whose cell could hold something overlapping the box.
+    template< typename F >
+    void VisitCells( float min_x, float min_y, float max_x, float max_y, F&& fn ) const {
+        if( mItems.empty() ) return;
+        // Boxes are filed by their centers, so look further out by the largest half size.
+        const int64_t i0 = std::max( CellCoordinate( min_x - mMaxExtent.x ), mLow.x );
+        const int64_t j0 = std::max( CellCoordinate( min_y - mMaxExtent.y ), mLow.y );
+        const int64_t i1 = std::min( CellCoordinate( max_x + mMaxExtent.x ), mHigh.x );
+        const int64_t j1 = std::min( CellCoordinate( max_y + mMaxExtent.y ), mHigh.y );
+        // If the box covers more cells than there are occupied cells, it's faster to go through the cells directly.
+        if( i0 > i1 || j0 > j1 ) return;
+        if( double( i1 - i0 + 1 ) * double( j1 - j0 + 1 ) > double( mCells.size() ) ) {
+            for( const auto& [key, list] : mCells ) {
+                const int64_t i = int32_t( key >> 32 ), j = int32_t( key & 0xffffffffu );
+                if( i < i0 || i > i1 || j < j0 || j > j1 ) continue;
+                for( uint32_t slot : list ) if( Current( mItems[slot] ) ) fn( mItems[slot] );
+            }
+            return;
+        }
+        for( int64_t j = j0; j <= j1; ++j ) {
+            for( int64_t i = i0; i <= i1; ++i ) VisitCell( i, j, [&]( const Item& item ) { if( Current( item ) ) fn( item ); } );
+        }
+    }
+
+    template< typename F >
+    void VisitCell( int64_t i, int64_t j, F&& fn ) const {
+        auto found = mCells.find( Key( i, j ) );
+        if( found == mCells.end() ) return;
+        for( uint32_t slot : found->second ) fn( mItems[slot] );
+    }
+
+    ECS& mECS;
+    float mCellSize;
+    float mInverseCellSize;
+
+    std::vector< Item > mItems;
+    // Indexed by `EntityID::Index()`.
+    std::vector< uint32_t > mSlots;
+    // Occupied cells only.
+    std::unordered_map< uint64_t, std::vector< uint32_t > > mCells;
+    // Every occupied cell is inside this range (it may be larger than necessary).
+    CellRange mLow{ std::numeric_limits< int64_t >::max(), std::numeric_limits< int64_t >::max() };
+    CellRange mHigh{ std::numeric_limits< int64_t >::min(), std::numeric_limits< int64_t >::min() };
+    // The largest half width and half height of any box.
+    Extent mMaxExtent;
+
+    uint64_t mPositionsSeen = 0;
+    uint64_t mSizesSeen = 0;
+    size_t mSweep = 0;
+    Extent mSweepExtent;
+};
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace ecs {
+namespace detail {
+    // Allocations made by this thread so far. Only counted in programs that define
+    // `ECS_PROFILER_COUNT_ALLOCATIONS` (see `profiler.h`); otherwise it stays at zero.
+    struct AllocationCount {
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+    };
+    inline AllocationCount& ThreadAllocations() {
+        static thread_local AllocationCount allocations;
+        return allocations;
+    }
+
+    // What queries did on behalf of whoever is measuring (a `Profiler::Scope`).
+    // Queries add to the calling thread's current `QueryStats`, if it has one.
+    struct QueryStats {
+        std::atomic< uint64_t > entities{ 0 };
+        std::atomic< uint64_t > chunks{ 0 };
+        std::atomic< uint64_t > allocations{ 0 };
+    };
+    inline QueryStats*& CurrentQueryStats() {
+        static thread_local QueryStats* current = nullptr;
+        return current;
+    }
+
+    inline void CountQuery( uint64_t entities, uint64_t chunks ) {
+        if( QueryStats* stats = CurrentQueryStats() ) {
+            stats->entities.fetch_add( entities, std::memory_order_relaxed );
+            stats->chunks.fetch_add( chunks, std::memory_order_relaxed );
+        }
+    }
+
+    // Makes `stats` the current thread's `QueryStats` until `Close()` or destruction,
+    // and adds the allocations this thread made in the meantime.
+    // Parallel loops open one on each thread that helps, so their work counts too.
+    class QueryStatsScope {
+    public:
+        explicit QueryStatsScope( QueryStats* stats ) : mStats( stats ), mPrevious( CurrentQueryStats() ) {
+            // Already counting into `stats` on this thread (a loop that ran inline), so don't count twice.
+            if( mStats == mPrevious ) mStats = nullptr;
+            if( !mStats ) return;
+            CurrentQueryStats() = mStats;
+            mAllocations = ThreadAllocations().count;
+        }
+        ~QueryStatsScope() { Close(); }
+        QueryStatsScope( const QueryStatsScope& ) = delete;
+        QueryStatsScope& operator=( const QueryStatsScope& ) = delete;
+
+        void Close() {
+            if( !mStats ) return;
+            mStats->allocations.fetch_add( ThreadAllocations().count - mAllocations, std::memory_order_relaxed );
+            CurrentQueryStats() = mPrevious;
+            mStats = nullptr;
+        }
+
+    private:
+        QueryStats* mStats;
+        QueryStats* mPrevious;
+        uint64_t mAllocations = 0;
+    };
+}
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ecs {
+
+// A small work-stealing thread pool for fork-join loops.
+//
+// `ParallelFor( count, task )` deals the task indices out in contiguous blocks,
+// one block per thread (the calling thread helps too). Each thread works through
+// its own block from the front. A thread that runs out steals from the back of
+// somebody else's block, so an uneven workload still keeps every core busy.
+// `ParallelFor()` returns once every task has finished.
+class ThreadPool {
+public:
+    // `threads` counts the calling thread, so `ThreadPool(1)` runs everything inline.
+    explicit ThreadPool( size_t threads = std::max( 1u, std::thread::hardware_concurrency() ) )
+        : mQueues( std::max< size_t >( threads, 1 ) )
+    {
+        for( auto& q : mQueues ) q = std::make_unique< Queue >();
+        for( size_t i = 1; i < mQueues.size(); ++i ) mWorkers.emplace_back( [this, i] { WorkerLoop( i ); } );
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard< std::mutex > lock( mMutex );
+            mQuit = true;
+        }
+        mWake.notify_all();
+        for( auto& t : mWorkers ) t.join();
+    }
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+
+    size_t NumThreads() const { return mQueues.size(); }
+
+    // Calls `task( i )` for every `i` in [0, count) and waits for all of them.
+    // If a task throws, the first exception is rethrown here after the others finish.
+    // Calling this from inside a task runs the inner loop serially on that thread.
+    void ParallelFor( size_t count, const std::function< void( size_t ) >& task ) {
+        if( count == 0 ) return;
+        if( mQueues.size() == 1 || count == 1 || InsideTask() ) {
+            for( size_t i = 0; i < count; ++i ) task( i );
+            return;
+        }
+
+        // One loop at a time.
+        std::lock_guard< std::mutex > submit( mSubmit );
+
+        // Deal out contiguous blocks.
+        const size_t n = mQueues.size();
+        for( size_t q = 0; q < n; ++q ) {
+            std::lock_guard< std::mutex > lock( mQueues[q]->mutex );
+            for( size_t i = count*q/n; i < count*(q+1)/n; ++i ) mQueues[q]->tasks.push_back( i );
+        }
+
+        {
+            std::lock_guard< std::mutex > lock( mMutex );
+            mTask = &task;
+            mRemaining = count;
+            mError = nullptr;
+            ++mJob;
+        }
+        mWake.notify_all();
+
+        // The calling thread is participant 0.
+        RunTasks( 0, task );
+
+        // Wait for the tasks and for every worker to let go of `task`.
+        std::unique_lock< std::mutex > lock( mMutex );
+        mDone.wait( lock, [&] { return mRemaining == 0 && mActive == 0; } );
+        mTask = nullptr;
+        if( mError ) std::rethrow_exception( mError );
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque< size_t > tasks;
+    };
+
+    static bool& InsideTask() {
+        static thread_local bool inside = false;
+        return inside;
+    }
+
+    bool PopOwn( size_t q, size_t& index ) {
+        std::lock_guard< std::mutex > lock( mQueues[q]->mutex );
+        if( mQueues[q]->tasks.empty() ) return false;
+        index = mQueues[q]->tasks.front();
+        mQueues[q]->tasks.pop_front();
+        return true;
+    }
+    bool Steal( size_t thief, size_t& index ) {
+        for( size_t k = 1; k < mQueues.size(); ++k ) {
+            Queue& victim = *mQueues[ ( thief + k ) % mQueues.size() ];
+            std::lock_guard< std::mutex > lock( victim.mutex );
+            if( victim.tasks.empty() ) continue;
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    void RunTasks( size_t q, const std::function< void( size_t ) >& task ) {
+        InsideTask() = true;
+        size_t index;
+        while( PopOwn( q, index ) || Steal( q, index ) ) {
+            try {
+                task( index );
+            } catch( ... ) {
+                std::lock_guard< std::mutex > lock( mMutex );
+                if( !mError ) mError = std::current_exception();
+            }
+
+            std::lock_guard< std::mutex > lock( mMutex );
+            --mRemaining;
+        }
+        InsideTask() = false;
+    }
+
+    void WorkerLoop( size_t q ) {
+        size_t seen = 0;
+        for( ;; ) {
+            const std::function< void( size_t ) >* task;
+            {
+                std::unique_lock< std::mutex > lock( mMutex );
+                mWake.wait( lock, [&] { return mQuit || ( mJob != seen && mTask ); } );
+                if( mQuit ) return;
+                seen = mJob;
+                task = mTask;
+                ++mActive;
+            }
+            RunTasks( q, *task );
+            {
+                std::lock_guard< std::mutex > lock( mMutex );
+                --mActive;
+            }
+            mDone.notify_all();
+        }
+    }
+
+    std::vector< std::unique_ptr< Queue > > mQueues;
+    std::vector< std::thread > mWorkers;
+
+    std::mutex mSubmit;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    const std::function< void( size_t ) >* mTask = nullptr;
+    size_t mRemaining = 0;
+    // Workers currently inside `RunTasks()`.
+    size_t mActive = 0;
+    size_t mJob = 0;
+    std::exception_ptr mError;
+    bool mQuit = false;
+};
+
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include "ecs.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace ecs {
+
+// An entity's position, rotation (in radians), and scale relative to its parent,
+// or to the world if it has no parent.
+struct LocalTransform {
+    float x = 0, y = 0;
+    float rotation = 0;
+    float scale_x = 1, scale_y = 1;
+};
+
+// Makes an entity the child of another. Its `LocalTransform` is then relative to the parent's.
+struct Parent {
+    EntityID entity;
+};
+
+// Where an entity ended up, as a 2D affine matrix. A point (px,py) in the entity's own
+// space lands at ( a*px + c*py + x, b*px + d*py + y ) in the world.
+// `TransformHierarchy` fills this in for entities that have one.
+struct WorldTransform {
+    float a = 1, b = 0, c = 0, d = 1;
+    float x = 0, y = 0;
+
+    static WorldTransform From( const LocalTransform& t ) {
+        const float cs = std::cos( t.rotation ), sn = std::sin( t.rotation );
+        return WorldTransform{ cs * t.scale_x, sn * t.scale_x, -sn * t.scale_y, cs * t.scale_y, t.x, t.y };
+    }
+    // `child` applied first, then this.
+    WorldTransform operator*( const WorldTransform& child ) const {
+        return WorldTransform{
+            a * child.a + c * child.b, b * child.a + d * child.b,
+            a * child.c + c * child.d, b * child.c + d * child.d,
+            a * child.x + c * child.y + x, b * child.x + d * child.y + y
+        };
+    }
+};
+
+// Computes a `WorldTransform` for every entity with a `LocalTransform`, parents before children.
+//
+// The entities are kept in one array sorted by depth: all the roots, then all of their
+// children, then all of their grandchildren, and so on (breadth first). Every parent comes
+// before its children, so a single pass from front to back can compute each world matrix
+// from its parent's, which is already done. The world matrices sit in a matching array,
+// and each node keeps a copy of its `LocalTransform`, so the pass never looks anything up.
+//
+// Call `Update()` once per frame, after anything has moved. Only entities whose
+// `LocalTransform` changed since the last `Update()` (see `Changed<>`) are dirty, and
+// a dirty entity makes its whole subtree dirty. Everything else is skipped. Adding,
+// dropping, or writing a `Parent` rebuilds the array, so reparenting costs a full pass.
+//
+// A parent that is dead or has no `LocalTransform` is ignored, so its children become roots.
+// A cycle of parents is broken at an arbitrary entity.
+//
+//     TransformHierarchy hierarchy( ecs );
+//     ecs.Add<Parent>( hand, Parent{ arm } );
+//     ...
+//     hierarchy.Update();
+//     const WorldTransform& w = ecs.Get<WorldTransform>( hand );
+class TransformHierarchy {
+public:
+    explicit TransformHierarchy( ECS& ecs ) : mECS( ecs ) {}
+
+    void Update() {
+        ++mFrame;
+
+        // Topology changes: any `Parent` written, added, or dropped, or any `LocalTransform` entity created or destroyed.
+        // Dropping is only visible in the counts, but anything added at the same time shows up as changed.
+        bool rebuild = Count< Parent >() != mNumParents || Count< LocalTransform >() != mNodes.size();
+        mECS.ForEach< const Parent, Changed< Parent > >( mParentsSeen, [&]( const Parent& ) { rebuild = true; } );
+        // Changes are tracked by chunk, so this also visits neighbors that didn't change. Comparing
+        // against the value from last time narrows it down to the entities that really moved.
+        mECS.ForEach< const LocalTransform, Changed< LocalTransform > >( mLocalsSeen, [&]( EntityID e, const LocalTransform& t ) {
+            const uint32_t node = NodeOf( e );
+            if( node == None ) {
+                rebuild = true;
+            } else if( !Same( mNodes[ node ].local, t ) ) {
+                mNodes[ node ].local = t;
+                mNodes[ node ].dirty = mFrame;
+            }
+        } );
+        if( rebuild ) Rebuild();
+
+        mNumUpdated = 0;
+        for( uint32_t i = 0; i < mNodes.size(); ++i ) {
+            Node& n = mNodes[i];
+            if( n.parent != None && mNodes[ n.parent ].dirty == mFrame ) n.dirty = mFrame;
+            if( n.dirty != mFrame ) continue;
+
+            const WorldTransform local = WorldTransform::From( n.local );
+            mWorld[i] = n.parent == None ? local : mWorld[ n.parent ] * local;
+            if( WorldTransform* w = mECS.TryGet< WorldTransform >( n.entity ) ) *w = mWorld[i];
+            ++mNumUpdated;
+        }
+    }
+
+    // The entity's world matrix as of the last `Update()`, or nullptr if it has no `LocalTransform`.
+    const WorldTransform* World( EntityID e ) const {
+        const uint32_t node = NodeOf( e );
+        return node == None ? nullptr : &mWorld[ node ];
+    }
+    // How many levels below a root the entity is (0 for a root), or -1 if it isn't in the hierarchy.
+    int Depth( EntityID e ) const {
+        const uint32_t node = NodeOf( e );
+        return node == None ? -1 : int( mNodes[ node ].depth );
+    }
+
+    size_t NumEntities() const { return mNodes.size(); }
+    // How many world matrices the last `Update()` recomputed.
+    size_t NumUpdated() const { return mNumUpdated; }
+
+private:
+    static constexpr uint32_t None = UINT32_MAX;
+
+    struct Node {
+        EntityID entity;
+        LocalTransform local;
+        // Index of the parent's node, which is always earlier in `mNodes`.
+        uint32_t parent;
+        uint32_t depth;
+        // The `Update()` that last found this node dirty.
+        uint32_t dirty;
+    };
+
+    static bool Same( const LocalTransform& a, const LocalTransform& b ) {
+        return a.x == b.x && a.y == b.y && a.rotation == b.rotation && a.scale_x == b.scale_x && a.scale_y == b.scale_y;
+    }
+
+    uint32_t NodeOf( EntityID e ) const {
+        if( e.Index() >= mNodeOf.size() ) return None;
+        const uint32_t node = mNodeOf[ e.Index() ];
+        return node != None && mNodes[ node ].entity == e ? node : None;
+    }
+
+    // How many entities have `T`, from the archetype sizes.
+    template< typename T >
+    size_t Count() const {
+        const ECS& ecs = mECS;
+        const ComponentID id = GetComponentID<T>();
+        size_t count = 0;
+        for( size_t i = 0; i < ecs.NumArchetypes(); ++i ) {
+            if( ecs.GetArchetype( i ).HasComponent( id ) ) count += ecs.GetArchetype( i ).Size();
+        }
+        return count;
+    }
+
+    // Sorts every entity with a `LocalTransform` into breadth-first order, and marks them all dirty.
+    void Rebuild() {
+        const ECS& ecs = mECS;
+        for( const Node& n : mNodes ) mNodeOf[ n.entity.Index() ] = None;
+
+        // Number the entities in the order the ECS has them, for now.
+        std::vector< EntityID >& entities = mScratchEntities;
+        std::vector< LocalTransform >& locals = mScratchLocals;
+        entities.clear();
+        locals.clear();
+        mECS.ForEach< const LocalTransform >( [&]( EntityID e, const LocalTransform& t ) {
+            entities.push_back( e );
+            locals.push_back( t );
+        } );
+        const uint32_t count = uint32_t( entities.size() );
+        for( uint32_t i = 0; i < count; ++i ) {
+            if( entities[i].Index() >= mNodeOf.size() ) mNodeOf.resize( entities[i].Index()+1, None );
+            mNodeOf[ entities[i].Index() ] = i;
+        }
+        // `NodeOf()` checks `mNodes`, so fill it in with the temporary numbering.
+        mNodes.assign( count, Node{ EntityID(), LocalTransform{}, None, 0, mFrame } );
+        for( uint32_t i = 0; i < count; ++i ) mNodes[i].entity = entities[i];
+
+        // Everyone's parent, then the children of each node, packed into one array.
+        std::vector< uint32_t >& parent = mScratchParent;
+        parent.assign( count, None );
+        std::vector< uint32_t >& first_child = mScratchFirstChild;
+        first_child.assign( count+1, 0 );
+        mNumParents = Count< Parent >();
+        for( uint32_t i = 0; i < count; ++i ) {
+            const Parent* p = ecs.TryGet< Parent >( entities[i] );
+            if( !p || !ecs.Alive( p->entity ) ) continue;
+            parent[i] = NodeOf( p->entity );
+            if( parent[i] == i ) parent[i] = None;
+            if( parent[i] != None ) ++first_child[ parent[i] + 1 ];
+        }
+        for( uint32_t i = 0; i < count; ++i ) first_child[i+1] += first_child[i];
+        std::vector< uint32_t >& children = mScratchChildren;
+        children.resize( first_child[ count ] );
+        std::vector< uint32_t >& next = mScratchNext;
+        next.assign( first_child.begin(), first_child.end() - 1 );
+        for( uint32_t i = 0; i < count; ++i ) if( parent[i] != None ) children[ next[ parent[i] ]++ ] = i;
+
+        // Breadth first from the roots. `order` doubles as the queue.
+        std::vector< uint32_t >& order = mScratchOrder;
+        order.clear();
+        std::vector< uint32_t >& depth = mScratchDepth;
+        depth.assign( count, None );
+        auto visit_from = [&]( uint32_t root ) {
+            depth[ root ] = 0;
+            size_t head = order.size();
+            order.push_back( root );
+            for( ; head < order.size(); ++head ) {
+                const uint32_t n = order[ head ];
+                for( uint32_t c = first_child[n]; c < first_child[n+1]; ++c ) {
+                    if( depth[ children[c] ] != None ) continue;
+                    depth[ children[c] ] = depth[n] + 1;
+                    order.push_back( children[c] );
+                }
+            }
+        };
+        for( uint32_t i = 0; i < count; ++i ) if( parent[i] == None ) visit_from( i );
+        // Anything not reached yet is in a cycle. Treat the first one found as a root.
+        for( uint32_t i = 0; i < count; ++i ) {
+            if( depth[i] != None ) continue;
+            parent[i] = None;
+            visit_from( i );
+        }
+
+        // Lay the nodes out in that order.
+        std::vector< uint32_t >& position = mScratchNext;
+        position.resize( count );
+        for( uint32_t k = 0; k < count; ++k ) position[ order[k] ] = k;
+        for( uint32_t k = 0; k < count; ++k ) {
+            const uint32_t i = order[k];
+            mNodes[k] = Node{ entities[i], locals[i], parent[i] == None ? None : position[ parent[i] ], depth[i], mFrame };
+            mNodeOf[ entities[i].Index() ] = k;
+        }
+        mWorld.resize( count );
+    }
+
+    ECS& mECS;
+    uint32_t mFrame = 0;
+
+    // Sorted by depth.
+    std::vector< Node > mNodes;
+    // Matches `mNodes`.
+    std::vector< WorldTransform > mWorld;
+    // Indexed by `EntityID::Index()`.
+    std::vector< uint32_t > mNodeOf;
+    size_t mNumParents = 0;
+    size_t mNumUpdated = 0;
+
+    uint64_t mParentsSeen = 0;
+    uint64_t mLocalsSeen = 0;
+
+    // Reused by `Rebuild()`.
+    std::vector< EntityID > mScratchEntities;
+    std::vector< LocalTransform > mScratchLocals;
+    std::vector< uint32_t > mScratchParent, mScratchFirstChild, mScratchChildren, mScratchNext, mScratchOrder, mScratchDepth;
+};
+
+}
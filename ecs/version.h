@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace ecs {
+
+// Change tracking works at the granularity of chunks of rows.
+// Each column (and each sparse set) keeps one version number per chunk: the value of the
+// ECS's version counter the last time something in that chunk was written or moved.
+// A `Changed< T >` query can then skip whole chunks nobody has touched.
+constexpr size_t ChunkSize = 1024;
+
+typedef std::atomic< uint64_t > VersionClock;
+
+// One version per chunk. Marking is a relaxed atomic store, so systems running on
+// several threads can mark chunks at the same time. Growing is not thread safe, but it
+// only happens during structural changes, which are never concurrent.
+class ChunkVersions {
+public:
+    // Make sure there is a version for every chunk needed to hold `rows` rows.
+    // New chunks start at version 0 (older than everything).
+    void Reserve( size_t rows ) {
+        const size_t chunks = ( rows + ChunkSize - 1 ) / ChunkSize;
+        if( chunks <= mNumChunks ) return;
+
+        std::unique_ptr< std::atomic< uint64_t >[] > versions( new std::atomic< uint64_t >[ chunks ] );
+        for( size_t c = 0; c < chunks; ++c ) versions[c].store( c < mNumChunks ? mVersions[c].load( std::memory_order_relaxed ) : 0, std::memory_order_relaxed );
+        mVersions = std::move( versions );
+        mNumChunks = chunks;
+    }
+
+    size_t NumChunks() const { return mNumChunks; }
+    uint64_t Get( size_t chunk ) const { return mVersions[ chunk ].load( std::memory_order_relaxed ); }
+
+    void Mark( size_t row, uint64_t version ) { mVersions[ row / ChunkSize ].store( version, std::memory_order_relaxed ); }
+    // Marks every chunk overlapping rows [begin, end).
+    void MarkRows( size_t begin, size_t end, uint64_t version ) {
+        if( begin >= end ) return;
+        for( size_t c = begin / ChunkSize; c <= ( end-1 ) / ChunkSize; ++c ) mVersions[c].store( version, std::memory_order_relaxed );
+    }
+
+private:
+    std::unique_ptr< std::atomic< uint64_t >[] > mVersions;
+    size_t mNumChunks = 0;
+};
+
+}
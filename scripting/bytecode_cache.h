@@ -0,0 +1,150 @@
+#pragma once
+
+#ifndef SOL_ALL_SAFETIES_ON
+#define SOL_ALL_SAFETIES_ON 1
+#endif
+#include <sol/sol.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+namespace scripting {
+
+// Skips parsing Lua source on later launches by caching the compiled bytecode on disk.
+//
+// `LoadFile( "scripts/enemy.lua" )` reads the source and hashes it. If
+// "scripts/enemy.lua.luac" exists and was made from source with the same hash, the
+// bytecode is loaded directly. Otherwise the source is compiled as usual and its
+// bytecode is written next to it (via `lua_dump`) for next time.
+//
+// Bytecode depends on the Lua version and build, so the cache file records those (and
+// whether debug information was stripped) and is only used by a matching build. If Lua
+// still refuses a cached chunk, the source is compiled instead and the cache file is rewritten.
+class BytecodeCache {
+public:
+    // `strip` drops debug information (line numbers in error messages) for smaller, faster chunks.
+    explicit BytecodeCache( sol::state& lua, bool strip = false ) : mLua( lua ), mStrip( strip ) {
+        mBuild.strip = strip ? 1 : 0;
+    }
+
+    // A drop-in replacement for `lua.load_file( path )`.
+    sol::load_result LoadFile( const std::string& path ) {
+        std::ifstream in( path, std::ios::binary );
+        if( !in ) return mLua.load_file( path ); // Let Lua report the error.
+        const std::string source( ( std::istreambuf_iterator<char>( in ) ), std::istreambuf_iterator<char>() );
+
+        return Load( source, "@" + path, path + ".luac" );
+    }
+
+    // Loads `source`, caching its bytecode in the file `cache_path`.
+    // `chunkname` is what Lua error messages call the chunk; "@path" means a file.
+    sol::load_result Load( const std::string& source, const std::string& chunkname, const std::string& cache_path ) {
+        const uint64_t hash = Hash( source );
+
+        std::string bytecode;
+        if( ReadCache( cache_path, hash, bytecode ) ) {
+            sol::load_result cached = mLua.load( std::string_view( bytecode ), chunkname, sol::load_mode::binary );
+            if( cached.valid() ) return cached;
+        }
+
+        sol::load_result compiled = mLua.load( std::string_view( source ), chunkname, sol::load_mode::text );
+        if( compiled.valid() ) {
+            sol::protected_function f = compiled;
+            WriteCache( cache_path, hash, Dump( f ) );
+        }
+        return compiled;
+    }
+
+    // The bytecode for a compiled function.
+    std::string Dump( const sol::protected_function& f ) const {
+        lua_State* L = mLua.lua_state();
+        std::string bytecode;
+        f.push( L );
+        lua_dump( L, &Writer, &bytecode, mStrip ? 1 : 0 );
+        lua_pop( L, 1 );
+        return bytecode;
+    }
+
+    // 64-bit FNV-1a. Good enough to notice that a script changed.
+    static uint64_t Hash( std::string_view data ) {
+        uint64_t hash = 14695981039346656037ull;
+        for( unsigned char c : data ) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+private:
+    // Everything besides the source that the bytecode depends on.
+    struct Build {
+#ifdef LUA_VERSION_RELEASE_NUM
+        uint32_t lua_version = LUA_VERSION_RELEASE_NUM;
+#else
+        uint32_t lua_version = LUA_VERSION_NUM;
+#endif
+        uint8_t number_size = sizeof( lua_Number );
+        uint8_t integer_size = sizeof( lua_Integer );
+        uint8_t size_t_size = sizeof( size_t );
+        uint8_t strip = 0;
+    };
+    static_assert( sizeof( Build ) == 8, "Build is written to the cache file as is, so it mustn't have padding." );
+
+    // Cache file layout: magic, format version, build, source hash, then the bytecode.
+    static constexpr char Magic[4] = { 'L', 'U', 'A', 'C' };
+    static constexpr uint32_t FormatVersion = 2;
+    static constexpr size_t HeaderSize = sizeof( Magic ) + sizeof( uint32_t ) + sizeof( Build ) + sizeof( uint64_t );
+
+    static int Writer( lua_State*, const void* data, size_t size, void* out ) {
+        static_cast< std::string* >( out )->append( static_cast< const char* >( data ), size );
+        return 0;
+    }
+
+    bool ReadCache( const std::string& path, uint64_t hash, std::string& bytecode ) const {
+        std::ifstream in( path, std::ios::binary );
+        if( !in ) return false;
+        const std::string contents( ( std::istreambuf_iterator<char>( in ) ), std::istreambuf_iterator<char>() );
+        if( contents.size() < HeaderSize || std::memcmp( contents.data(), Magic, sizeof( Magic ) ) != 0 ) return false;
+
+        uint32_t version;
+        uint64_t cached_hash;
+        const char* at = contents.data() + sizeof( Magic );
+        std::memcpy( &version, at, sizeof( version ) );
+        at += sizeof( version );
+        if( version != FormatVersion || std::memcmp( at, &mBuild, sizeof( mBuild ) ) != 0 ) return false;
+        at += sizeof( mBuild );
+        std::memcpy( &cached_hash, at, sizeof( cached_hash ) );
+        if( cached_hash != hash ) return false;
+
+        bytecode = contents.substr( HeaderSize );
+        return true;
+    }
+
+    void WriteCache( const std::string& path, uint64_t hash, const std::string& bytecode ) const {
+        // Write a temporary file and rename it, so a crash never leaves a half-written cache.
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream out( temporary, std::ios::binary | std::ios::trunc );
+            if( !out ) return; // The cache is only an optimization. A read-only directory is fine.
+            out.write( Magic, sizeof( Magic ) );
+            out.write( reinterpret_cast< const char* >( &FormatVersion ), sizeof( FormatVersion ) );
+            out.write( reinterpret_cast< const char* >( &mBuild ), sizeof( mBuild ) );
+            out.write( reinterpret_cast< const char* >( &hash ), sizeof( hash ) );
+            out.write( bytecode.data(), std::streamsize( bytecode.size() ) );
+            if( !out ) return;
+        }
+        std::error_code ignored;
+        std::filesystem::rename( temporary, path, ignored );
+    }
+
+    sol::state& mLua;
+    bool mStrip;
+    Build mBuild;
+};
+
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#ifndef SOL_ALL_SAFETIES_ON
+#define SOL_ALL_SAFETIES_ON 1
+#endif
+#include <sol/sol.hpp>
+
+#include "bytecode_cache.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace scripting {
+
+// Small integer handles. Look them up by name once (say, when a `Script` component
+// is created) and keep them. Running or calling through a handle is a vector index,
+// not a string lookup.
+typedef uint32_t ScriptHandle;
+typedef uint32_t FunctionHandle;
+typedef uint32_t TableHandle;
+constexpr uint32_t InvalidHandle = UINT32_MAX;
+
+// What loading a script gives back: its handle, or why it didn't load.
+struct LoadResult {
+    ScriptHandle handle = InvalidHandle;
+    // Lua's error message. Empty if the script loaded.
+    std::string error;
+
+    bool valid() const { return handle != InvalidHandle; }
+};
+
+// Loads scripts once and hands out handles to them and to Lua globals like
+// `ECS.ForEach`, so the per-frame code doesn't repeat `lua["ECS"]["ForEach"]`.
+//
+// Reloading a script keeps its handle; the handle just runs the new code.
+// A reloaded script usually redefines the globals it defined before, so once it has
+// been `Run()`, the cached functions and tables are looked up again the next time
+// they're used. A lookup that finds nothing isn't cached, so globals a new script
+// defines are picked up too. Call `Invalidate()` if anything else replaces globals.
+//
+// With an `ecs::Profiler`, every `Run()` is measured as "[script] name". A script run from
+// inside a scheduled system shows up in both rows.
+class ScriptCache {
+public:
+    explicit ScriptCache( sol::state& lua ) : mLua( lua ) {
+        // Running a bad handle runs this instead, so the caller gets an error back like any other script's.
+        sol::load_result invalid = mLua.load( "error( 'ScriptCache: invalid script handle', 0 )", "=ScriptCache" );
+        mInvalidScript = invalid.get< sol::protected_function >();
+        sol::load_result invalid_function = mLua.load( "error( 'ScriptCache: invalid function handle', 0 )", "=ScriptCache" );
+        mInvalidFunction = invalid_function.get< sol::protected_function >();
+    }
+
+    // Loads (or reloads) the script at `path` under `name`.
+    // If it doesn't compile, the result's handle is `InvalidHandle` and its error says why.
+    LoadResult LoadScript( const std::string& name, const std::string& path ) {
+        return Store( name, mBytecode ? mBytecode->LoadFile( path ) : mLua.load_file( path ) );
+    }
+    // Same, but from source code in a string.
+    LoadResult LoadScriptString( const std::string& name, const std::string& source ) {
+        return Store( name, mLua.load( source, name ) );
+    }
+
+    ScriptHandle FindScript( const std::string& name ) const {
+        auto found = mScriptNames.find( name );
+        return found == mScriptNames.end() ? InvalidHandle : found->second;
+    }
+
+    // An invalid handle (say, from a failed load) gives back an error result instead of running anything.
+    template< typename... Args >
+    sol::protected_function_result Run( ScriptHandle script, Args&&... args ) {
+        sol::protected_function_result result;
+        if( mProfiler && script < mProfiles.size() ) {
+            ecs::Profiler::Scope scope( *mProfiler, mProfiles[ script ] );
+            result = Script( script )( std::forward<Args>( args )... );
+        } else {
+            result = Script( script )( std::forward<Args>( args )... );
+        }
+        // The first run after a reload is when the globals change, even if it fails partway.
+        if( script < mReloaded.size() && mReloaded[ script ] ) {
+            mReloaded[ script ] = false;
+            Invalidate();
+        }
+        return result;
+    }
+    // For an invalid handle, a function that only raises an error.
+    // Calling this directly doesn't tell the cache that a reloaded script has run; `Run()` does.
+    sol::protected_function& Script( ScriptHandle script ) {
+        return script < mScripts.size() ? mScripts[ script ] : mInvalidScript;
+    }
+
+    // Handles to Lua globals by dotted path, like "ECS.ForEach".
+    FunctionHandle FindFunction( const std::string& path ) { return Intern( mFunctions, path ); }
+    TableHandle FindTable( const std::string& path ) { return Intern( mTables, path ); }
+
+    // Like `Script()`, an invalid handle gives a function that only raises an error, and an empty table.
+    sol::protected_function& Function( FunctionHandle f ) { return f < mFunctions.size() ? Resolve( mFunctions[f] ) : mInvalidFunction; }
+    sol::table& Table( TableHandle t ) { return t < mTables.size() ? Resolve( mTables[t] ) : mInvalidTable; }
+
+    template< typename... Args >
+    sol::protected_function_result Call( FunctionHandle f, Args&&... args ) {
+        return Function( f )( std::forward<Args>( args )... );
+    }
+
+    // With a bytecode cache, `LoadScript()` skips parsing scripts that haven't changed since last time.
+    void UseBytecodeCache( BytecodeCache* cache ) { mBytecode = cache; }
+
+    // Call this if something other than `LoadScript()` changes Lua's globals.
+    void Invalidate() { ++mGeneration; }
+
+    // Starts measuring `Run()` with `profiler`, or stops if it's nullptr. The profiler must outlive
+    // the cache. Outside a `Scheduler`, call `profiler.EndFrame()` yourself once per frame.
+    void SetProfiler( ecs::Profiler* profiler ) {
+        mProfiler = profiler;
+        if( !mProfiler ) return;
+        mProfiles.resize( mScripts.size() );
+        for( const auto& [name, handle] : mScriptNames ) mProfiles[ handle ] = mProfiler->AddSystem( ProfileName( name ) );
+    }
+
+private:
+    template< typename T >
+    struct Cached {
+        std::string path;
+        T value;
+        // The value is only good if this matches `mGeneration`.
+        uint32_t generation = UINT32_MAX;
+    };
+
+    LoadResult Store( const std::string& name, sol::load_result loaded ) {
+        if( !loaded.valid() ) {
+            sol::error error = loaded;
+            return LoadResult{ InvalidHandle, "Failed to load script " + name + ": " + error.what() };
+        }
+
+        // Don't keep the `load_result` itself; it can become invalid. Keep a `protected_function`.
+        sol::protected_function script = loaded;
+
+        auto found = mScriptNames.find( name );
+        if( found != mScriptNames.end() ) {
+            mScripts[ found->second ] = std::move( script );
+            // The globals only change once the new code runs.
+            mReloaded[ found->second ] = true;
+            return LoadResult{ found->second, std::string() };
+        }
+        mScripts.push_back( std::move( script ) );
+        mReloaded.push_back( false );
+        if( mProfiler ) mProfiles.push_back( mProfiler->AddSystem( ProfileName( name ) ) );
+        const ScriptHandle handle = ScriptHandle( mScripts.size()-1 );
+        mScriptNames[ name ] = handle;
+        return LoadResult{ handle, std::string() };
+    }
+
+    static std::string ProfileName( const std::string& name ) { return "[script] " + name; }
+
+    template< typename T >
+    uint32_t Intern( std::vector< Cached<T> >& cache, const std::string& path ) {
+        for( uint32_t i = 0; i < cache.size(); ++i ) if( cache[i].path == path ) return i;
+        cache.push_back( Cached<T>{ path, T(), UINT32_MAX } );
+        return uint32_t( cache.size()-1 );
+    }
+
+    template< typename T >
+    T& Resolve( Cached<T>& cached ) {
+        if( cached.generation != mGeneration ) {
+            // Walk "a.b.c" from the globals table.
+            sol::object current = mLua.globals();
+            size_t start = 0;
+            while( start <= cached.path.size() && current.get_type() == sol::type::table ) {
+                const size_t dot = std::min( cached.path.find( '.', start ), cached.path.size() );
+                current = current.as< sol::table >().get< sol::object >( cached.path.substr( start, dot-start ) );
+                start = dot+1;
+            }
+            const bool found = start > cached.path.size() && current.is<T>();
+            cached.value = found ? current.as<T>() : T();
+            // Keep looking until it's there; a script may define it later.
+            cached.generation = found ? mGeneration : UINT32_MAX;
+        }
+        return cached.value;
+    }
+
+    sol::state& mLua;
+    BytecodeCache* mBytecode = nullptr;
+    std::vector< sol::protected_function > mScripts;
+    // Reloaded, but not run since. Matches `mScripts`.
+    std::vector< bool > mReloaded;
+    sol::protected_function mInvalidScript;
+    sol::protected_function mInvalidFunction;
+    sol::table mInvalidTable;
+    std::unordered_map< std::string, ScriptHandle > mScriptNames;
+    std::vector< Cached< sol::protected_function > > mFunctions;
+    std::vector< Cached< sol::table > > mTables;
+    uint32_t mGeneration = 0;
+    ecs::Profiler* mProfiler = nullptr;
+    // Each script's number in `mProfiler`, by handle.
+    std::vector< uint32_t > mProfiles;
+};
+
+}
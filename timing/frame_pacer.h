@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace timing {
+
+// Keeps a game loop (or a server tick) running at a fixed rate.
+//
+// The simulation advances in fixed steps of `Step()` seconds. `Advance()` adds the
+// real time that passed since the last frame to an accumulator and says how many
+// steps to take. If a frame ran long, the next frame takes several steps to catch up,
+// but never more than `max_steps`; beyond that, time is dropped rather than letting
+// the game fall further and further behind. `Alpha()` is how far we are between the
+// last step and the next, for interpolating what gets drawn.
+//
+// `WaitForNextTick()` waits until the next tick on a fixed schedule. Ticks are
+// absolute times (start + n*step), so a late frame doesn't push every later tick back.
+// `std::this_thread::sleep_for()` alone can overshoot by the OS scheduler's quantum
+// (often 1--15 ms), so it sleeps only while it's sure not to overshoot, then spins
+// on `steady_clock` for the last stretch.
+//
+//     timing::FramePacer pacer( 1./60 );
+//     while( running ) {
+//         for( int i = pacer.Advance(); i > 0; --i ) Update( pacer.Step() );
+//         Draw( pacer.Alpha() );
+//         pacer.WaitForNextTick();
+//     }
+class FramePacer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit FramePacer( double step_seconds, int max_steps = 5 )
+        : mStep( std::chrono::duration_cast< Clock::duration >( std::chrono::duration< double >( step_seconds ) ) ),
+          mMaxSteps( std::max( max_steps, 1 ) )
+    {
+        Reset();
+    }
+
+    // Start over from now, for example after loading a level.
+    void Reset() {
+        mPrevious = Clock::now();
+        mNextTick = mPrevious + mStep;
+        mAccumulator = Clock::duration::zero();
+    }
+
+    // How many fixed steps to simulate this frame.
+    int Advance() {
+        const Clock::time_point now = Clock::now();
+        mAccumulator += now - mPrevious;
+        mPrevious = now;
+
+        // Don't try to catch up on more than `max_steps` at once.
+        mAccumulator = std::min( mAccumulator, mStep * mMaxSteps );
+        const int steps = int( mAccumulator / mStep );
+        mAccumulator -= mStep * steps;
+        return steps;
+    }
+
+    // The fixed step in seconds.
+    double Step() const { return std::chrono::duration< double >( mStep ).count(); }
+    // How far past the last simulated step we are, from 0 to 1.
+    double Alpha() const { return std::chrono::duration< double >( mAccumulator ) / mStep; }
+
+    // Waits until the next tick.
+    void WaitForNextTick() {
+        const Clock::time_point now = Clock::now();
+        // If we are hopelessly behind, restart the schedule instead of rushing through missed ticks.
+        if( now > mNextTick + mStep * mMaxSteps ) mNextTick = now;
+        SleepUntil( mNextTick );
+        mNextTick += mStep;
+    }
+
+    // Sleeps until `deadline`, spinning for the last part for precision.
+    void SleepUntil( Clock::time_point deadline ) {
+        using namespace std::chrono;
+        for( ;; ) {
+            const Clock::time_point start = Clock::now();
+            if( duration< double >( deadline - start ).count() <= mSleepEstimate ) break;
+
+            std::this_thread::sleep_for( milliseconds( 1 ) );
+
+            // Learn how long a 1 ms sleep can take: the longest one lately. A longer sleep raises
+            // the estimate right away; shorter ones only lower it a little at a time, so a rare
+            // slow wakeup keeps counting for a few hundred sleeps. A mean (even plus a standard
+            // deviation) would be overshot by a sizable fraction of sleeps.
+            const double observed = duration< double >( Clock::now() - start ).count();
+            if( observed > mSleepEstimate ) mSleepEstimate = observed;
+            else mSleepEstimate -= ( mSleepEstimate - observed ) * SleepEstimateDecay;
+        }
+
+        // Spin.
+        while( Clock::now() < deadline ) {}
+    }
+
+private:
+    Clock::duration mStep;
+    int mMaxSteps;
+
+    Clock::time_point mPrevious;
+    Clock::time_point mNextTick;
+    Clock::duration mAccumulator;
+
+    // How long `sleep_for( 1ms )` can take, in seconds. Starts out cautious.
+    double mSleepEstimate = 0.005;
+    // How far each shorter sleep pulls the estimate toward itself.
+    static constexpr double SleepEstimateDecay = 0.005;
+};
+
+}
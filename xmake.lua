@@ -45,6 +45,13 @@ target("chrono")
     
     add_files("demo/chrono_sleep_for.cpp")
 
+target("frame_pacer")
+    set_kind("binary")
+    set_languages("cxx17")
+    
+    add_includedirs("timing")
+    add_files("demo/frame_pacer.cpp")
+
 target("friend")
     set_kind("binary")
     set_languages("cxx17")
@@ -69,6 +76,7 @@ target("disco")
     
     add_includedirs("disco", {public = true})
     add_files("disco/*.cpp")
+    add_syslinks("pthread", {public = true})
 
 target("disco_demo")
     set_kind("binary")
@@ -82,12 +90,73 @@ target("globals")
     
     add_files("globals/*.cpp")
 
+target("ecs")
+    set_kind("headeronly")
+    
+    add_includedirs("ecs", {public = true})
+    add_headerfiles("ecs/*.h")
+    add_syslinks("pthread", {public = true})
+
 target("entity_get")
     set_kind("binary")
     set_languages("cxx17")
-    
+    add_deps("ecs")
     add_files("demo/entity_get.cpp")
 
+target("ecs_foreach")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs")
+    add_files("demo/ecs_foreach.cpp")
+
+target("ecs_scheduler")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs")
+    add_files("demo/ecs_scheduler.cpp")
+
+target("ecs_snapshot")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs")
+    add_files("demo/ecs_snapshot.cpp")
+
+target("ecs_spatial_grid")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs")
+    add_files("demo/ecs_spatial_grid.cpp")
+
+target("ecs_broadphase")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs")
+    add_files("demo/ecs_broadphase.cpp")
+
+target("ecs_integrate")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs")
+    add_files("demo/ecs_integrate.cpp")
+
+target("ecs_transform")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs")
+    add_files("demo/ecs_transform.cpp")
+
+target("ecs_prefab")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs")
+    add_files("demo/ecs_prefab.cpp")
+
+target("ecs_profiler")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs")
+    add_files("demo/ecs_profiler.cpp")
+
 target("lua_parameters")
     set_kind("binary")
     set_languages("cxx17")
@@ -101,3 +170,36 @@ target("lua_globals")
     
     add_packages("sol2", "lua")
     add_files("demo/lua_globals.cpp")
+
+target("lua_ecs")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs")
+    add_packages("sol2", "lua")
+    add_files("demo/lua_ecs.cpp")
+
+target("scripting")
+    set_kind("headeronly")
+    add_deps("ecs")
+    
+    add_includedirs("scripting", {public = true})
+    add_headerfiles("scripting/*.h")
+    add_packages("sol2", "lua", {public = true})
+
+target("lua_script_cache")
+    set_kind("binary")
+    set_languages("cxx17")
+    add_deps("ecs", "scripting")
+    add_packages("sol2", "lua")
+    add_files("demo/lua_script_cache.cpp")
+
+target("lua_bytecode_cache")
+    set_kind("binary")
+    set_languages("cxx17")
+    
+    -- Set the working directory so the binary sees `data`
+    set_rundir("$(projectdir)")
+    
+    add_deps("scripting")
+    add_packages("sol2", "lua")
+    add_files("demo/lua_bytecode_cache.cpp")